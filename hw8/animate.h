@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+#include "grid.h"
+#include "render.h"
+#include "tiles.h"
+
+// World units per frame.
+struct Velocity {
+    double x = 0, y = 0;
+};
+
+// Moves every site by its velocity times dt.
+void advancePoints(std::vector<Point> &points, const std::vector<Velocity> &velocities, double dt) {
+    for (size_t i = 0; i < points.size() && i < velocities.size(); ++i) {
+        points[i].x += velocities[i].x * dt;
+        points[i].y += velocities[i].y * dt;
+    }
+}
+
+// Exact labels for a sequence of frames in which the same sites move a little at a time. Along
+// with each pixel's label the animator keeps how far the sites may still move before that
+// label could be wrong: if the runner-up is g farther than the winner, the two can only swap
+// once the sites involved have moved by more than g / 2 in total, by the triangle inequality.
+//
+// Movement is tracked per TILE_SIZE tile. A tile only needs to hear about sites that were, or
+// now are, within its pixels' runner-up distance, so each frame buckets the moving sites by
+// their old and new positions and adds to every tile the largest displacement among the sites
+// within reach of it. Tiles that nothing moved near are skipped outright, and inside the others
+// only the pixels whose budget that tile's drift has used up are searched again, which are the
+// ones near cell boundaries. A frame costs one pass over the sites plus work proportional to
+// the movement, not to the image.
+//
+// Weighted keys and Minkowski exponents below 1 have no triangle inequality, and a different
+// site count breaks the correspondence with the last frame, so those frames are rendered in full.
+template<class M>
+class Animator {
+public:
+    explicit Animator(const RenderOptions &options)
+            : options(options),
+              metric(metricFor<M>(options)),
+              tileCols((options.width + TILE_SIZE - 1) / TILE_SIZE),
+              tileRows((options.height + TILE_SIZE - 1) / TILE_SIZE) {}
+
+    // Labels for the sites at these positions, in world units and in the same order every frame.
+    const std::vector<int> &render(const std::vector<Point> &points) {
+        PROFILE_STAGE("raster");
+        std::vector<Point> pixels = toPixelSpace(points, options.view);
+        grid.build(pixels);
+        if (sites.empty() || pixels.size() != sites.size() || !hasTriangleInequality()) {
+            size_t count = static_cast<size_t>(options.width) * options.height;
+            labels.assign(count, -1);
+            expiry.assign(count, 0);
+            reach.assign(count, 0);
+            tiles.assign(static_cast<size_t>(tileCols) * tileRows, TileState());
+            verify(true);
+        } else {
+            spreadMovement(pixels);
+            verify(false);
+        }
+        sites = std::move(pixels);
+        return labels;
+    }
+
+    // Pixels searched again by the last frame.
+    size_t lastVerified() const {
+        return verified;
+    }
+
+private:
+    struct TileState {
+        float drift = 0;  // movement that has reached the tile, in pixels
+        float reach = 0;  // largest runner-up distance of its pixels, less the drift when searched
+        bool moved = false;
+    };
+
+    RenderOptions options;
+    M metric;
+    int tileCols, tileRows;
+    SiteGrid grid;
+    std::vector<Point> sites;
+    std::vector<int> labels;
+    std::vector<float> expiry;  // tile drift at which the pixel must be searched again
+    std::vector<float> reach;   // runner-up distance less the tile drift when it was searched
+    std::vector<TileState> tiles;
+    size_t verified = 0;
+
+    bool hasTriangleInequality() const {
+        if constexpr (M::WEIGHTED) {
+            return false;
+        } else if constexpr (std::is_same_v<M, MinkowskiMetric>) {
+            return metric.exponent >= 1;
+        } else {
+            return true;
+        }
+    }
+
+    // Every pixel of a tile has its runner-up within reach + drift before this frame, and no
+    // site moves further than the largest displacement, so a site outside the tile grown by
+    // their sum at both ends of its move can neither be nor become a winner or runner-up there.
+    // Every norm is at least the Chebyshev distance, so growing the tile square is enough.
+    // Sites beyond the image count toward the border buckets, which only errs on the safe side.
+    void spreadMovement(const std::vector<Point> &pixels) {
+        std::vector<float> buckets(tiles.size(), 0);
+        auto bucket = [&](const Point &p) -> float & {
+            int bx = static_cast<int>(std::clamp(std::floor(p.x / TILE_SIZE), 0.0, tileCols - 1.0));
+            int by = static_cast<int>(std::clamp(std::floor(p.y / TILE_SIZE), 0.0, tileRows - 1.0));
+            return buckets[static_cast<size_t>(by) * tileCols + bx];
+        };
+        float largest = 0;
+        for (size_t i = 0; i < pixels.size(); ++i) {
+            float dx = static_cast<float>(pixels[i].x - sites[i].x);
+            float dy = static_cast<float>(pixels[i].y - sites[i].y);
+            float moved = M::distance(siteKey(dx, dy, 0, metric));
+            if (!(moved > 0)) continue;
+            largest = std::max(largest, moved);
+            bucket(sites[i]) = std::max(bucket(sites[i]), moved);
+            bucket(pixels[i]) = std::max(bucket(pixels[i]), moved);
+        }
+
+        auto cellRange = [](float lo, float hi, int cells, int &c0, int &c1) {
+            c0 = static_cast<int>(std::clamp(std::floor(lo / TILE_SIZE), 0.0f, cells - 1.0f));
+            c1 = static_cast<int>(std::clamp(std::floor(hi / TILE_SIZE), 0.0f, cells - 1.0f));
+        };
+        for (int ty = 0; ty < tileRows; ++ty) {
+            for (int tx = 0; tx < tileCols; ++tx) {
+                TileState &tile = tiles[static_cast<size_t>(ty) * tileCols + tx];
+                tile.moved = false;
+                if (largest == 0) continue;
+                float r = tile.reach + tile.drift + largest;
+                int x0, x1, y0, y1;
+                cellRange(tx * TILE_SIZE - r, (tx + 1) * TILE_SIZE + r, tileCols, x0, x1);
+                cellRange(ty * TILE_SIZE - r, (ty + 1) * TILE_SIZE + r, tileRows, y0, y1);
+                float step = 0;
+                for (int y = y0; y <= y1; ++y) {
+                    for (int x = x0; x <= x1; ++x) {
+                        step = std::max(step, buckets[static_cast<size_t>(y) * tileCols + x]);
+                    }
+                }
+                tile.drift += step;
+                tile.moved = step > 0;
+            }
+        }
+    }
+
+    // Searches every pixel whose budget its tile's drift has used up, or every pixel when all
+    // is set. The budget gives up a small relative margin, so float rounding in the keys cannot
+    // flip a pixel unnoticed; ties have no budget at all and are searched whenever the tile moves.
+    void verify(bool all) {
+        int width = options.width;
+        std::vector<size_t> counts(std::max(1, options.threads), 0);
+        forEachTileOnWorkers(width, options.height, options.threads, [&](const Tile &t, int worker) {
+            TileState &tile = tiles[static_cast<size_t>(t.y0 / TILE_SIZE) * tileCols + t.x0 / TILE_SIZE];
+            if (!all && !tile.moved) return;
+            // Budgets count from the tile's drift; rebasing keeps its float precision.
+            if (tile.drift > 256) {
+                for (int y = t.y0; y < t.y1; ++y) {
+                    for (int x = t.x0; x < t.x1; ++x) {
+                        size_t i = static_cast<size_t>(y) * width + x;
+                        expiry[i] = std::max(0.0f, expiry[i] - tile.drift);
+                        reach[i] += tile.drift;
+                    }
+                }
+                tile.drift = 0;
+            }
+
+            size_t count = 0;
+            float tileReach = 0;
+            for (int y = t.y0; y < t.y1; ++y) {
+                for (int x = t.x0; x < t.x1; ++x) {
+                    size_t i = static_cast<size_t>(y) * width + x;
+                    if (all || expiry[i] <= tile.drift) {
+                        float bestKey, secondKey;
+                        labels[i] = grid.nearestTwo(static_cast<float>(x), static_cast<float>(y), bestKey,
+                                                    secondKey, metric);
+                        float nearest = M::distance(bestKey);
+                        float runnerUp = M::distance(secondKey);
+                        float gap = runnerUp - nearest - 1e-4f * (1.0f + runnerUp);
+                        expiry[i] = (labels[i] == -1 || !(gap > 0)) ? tile.drift : tile.drift + gap / 2;
+                        reach[i] = runnerUp - tile.drift;
+                        ++count;
+                    }
+                    tileReach = std::max(tileReach, reach[i]);
+                }
+            }
+            tile.reach = tileReach;
+            counts[worker] += count;
+        });
+        verified = 0;
+        for (size_t count: counts) verified += count;
+    }
+};
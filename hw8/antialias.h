@@ -0,0 +1,74 @@
+#pragma once
+
+#include <SDL.h>
+#include <algorithm>
+#include <vector>
+#include "grid.h"
+#include "render.h"
+#include "tiles.h"
+
+// Final color of one pixel on a cell border.
+struct BlendedPixel {
+    size_t index;
+    SDL_Color color;
+};
+
+// Anti-aliases the cell borders of a finished label buffer. Only pixels with a 4-neighbour of
+// a different owner are touched: each gets options.antialias squared stratified nearest-site
+// searches over its square and the owners' colors averaged by how many samples they won, "no
+// site" counting as opaque black. Interior pixels keep their flat color, so the extra work is
+// proportional to the length of the borders rather than the area of the image. The samples come
+// from the exact grid search whatever mode produced the labels; points are in pixel space.
+template<class M>
+std::vector<BlendedPixel> antialiasBorders(const std::vector<Point> &points, const std::vector<int> &labels,
+                                           const RenderOptions &options) {
+    int samples = options.antialias;
+    if (samples < 2 || points.empty()) return {};
+    PROFILE_STAGE("antialias");
+    int width = options.width;
+    int height = options.height;
+    int workers = std::max(1, options.threads);
+    std::vector<std::vector<BlendedPixel>> found(workers);
+    SiteGrid grid;
+    grid.build(points);
+    const M metric = metricFor<M>(options);
+    const SDL_Color noSiteColor = {0, 0, 0, 255};
+    const unsigned count = static_cast<unsigned>(samples * samples);
+    const float step = 1.0f / samples;
+
+    forEachTileOnWorkers(width, height, workers, [&](const Tile &tile, int worker) {
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x = tile.x0; x < tile.x1; ++x) {
+                size_t i = static_cast<size_t>(y) * width + x;
+                int owner = labels[i];
+                bool border = (x > 0 && labels[i - 1] != owner) || (x + 1 < width && labels[i + 1] != owner) ||
+                              (y > 0 && labels[i - width] != owner) ||
+                              (y + 1 < height && labels[i + width] != owner);
+                if (!border) continue;
+
+                unsigned r = 0, g = 0, b = 0, a = 0;
+                for (int sy = 0; sy < samples; ++sy) {
+                    float py = y - 0.5f + (sy + 0.5f) * step;
+                    for (int sx = 0; sx < samples; ++sx) {
+                        int site = grid.nearest(x - 0.5f + (sx + 0.5f) * step, py, metric);
+                        const SDL_Color &c = site < 0 ? noSiteColor : points[site].color;
+                        r += c.r;
+                        g += c.g;
+                        b += c.b;
+                        a += c.a;
+                    }
+                }
+                found[worker].push_back({i, {static_cast<Uint8>((r + count / 2) / count),
+                                             static_cast<Uint8>((g + count / 2) / count),
+                                             static_cast<Uint8>((b + count / 2) / count),
+                                             static_cast<Uint8>((a + count / 2) / count)}});
+            }
+        }
+    });
+
+    std::vector<BlendedPixel> blended;
+    for (auto &pixels: found) {
+        blended.insert(blended.end(), pixels.begin(), pixels.end());
+    }
+    return blended;
+}
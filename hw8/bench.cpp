@@ -0,0 +1,250 @@
+// Benchmarks of the Voronoi pipeline stage by stage: loading (DOM and streaming), color mapping,
+// rendering per metric and per search mode, spot drawing and PNG encoding, over synthetic
+// uniform, clustered and gridded point sets of 10 to 10^6 sites. Render rates are reported as
+// pixels/s and site_pixels/s (sites times pixels per second, the brute-force workload), so runs
+// with different sizes stay comparable.
+//
+// Build next to main.cpp against SDL2 and Google Benchmark, e.g.
+//   g++ -std=c++17 -O2 bench.cpp -lbenchmark -lpthread -lSDL2 -o bench
+// and keep a JSON report per commit to compare with benchmark's tools/compare.py:
+//   bench --benchmark_out=bench.json --benchmark_out_format=json
+//   compare.py benchmarks before.json after.json
+// Renders run on one thread so the numbers do not depend on the machine's core count.
+#include <benchmark/benchmark.h>
+#include <SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "draw.h"
+#include "loader.h"
+#include "png.h"
+#include "render.h"
+
+const int BENCH_WIDTH = 512;
+const int BENCH_HEIGHT = 512;
+
+enum PointSet {
+    UNIFORM,
+    CLUSTERED,
+    GRIDDED
+};
+
+const char *pointSetName(int kind) {
+    switch (kind) {
+        case CLUSTERED:
+            return "clustered";
+        case GRIDDED:
+            return "gridded";
+        default:
+            return "uniform";
+    }
+}
+
+// n sites over a width x height image, the same for every run. Clustered sets are Gaussian blobs
+// around 16 centres; gridded sets sit on a square lattice, which is full of exact ties. Every
+// site gets a weight of up to half the mean spacing, which only the weighted metrics read.
+std::vector<Point> makePoints(int kind, int n, int width, int height) {
+    std::mt19937 rng(12345 + n * 3 + kind);
+    std::uniform_real_distribution<double> unitX(0, width), unitY(0, height);
+    std::uniform_int_distribution<int> channel(0, 255);
+    std::uniform_real_distribution<double> weight(0, std::sqrt(static_cast<double>(width) * height / n) / 2);
+    std::vector<Point> centres;
+    for (int c = 0; c < 16; ++c) {
+        centres.push_back({unitX(rng), unitY(rng), {}});
+    }
+    std::normal_distribution<double> spread(0, std::min(width, height) / 32.0);
+    int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(n))));
+    double spacing = static_cast<double>(std::max(width, height)) / columns;
+
+    std::vector<Point> points(n);
+    for (int i = 0; i < n; ++i) {
+        Point &p = points[i];
+        if (kind == CLUSTERED) {
+            const Point &centre = centres[i % centres.size()];
+            p.x = centre.x + spread(rng);
+            p.y = centre.y + spread(rng);
+        } else if (kind == GRIDDED) {
+            p.x = (i % columns + 0.5) * spacing;
+            p.y = (i / columns + 0.5) * spacing;
+        } else {
+            p.x = unitX(rng);
+            p.y = unitY(rng);
+        }
+        p.weight = weight(rng);
+        p.color = {static_cast<Uint8>(channel(rng)), static_cast<Uint8>(channel(rng)),
+                   static_cast<Uint8>(channel(rng)), 255};
+    }
+    return points;
+}
+
+std::string spotsJson(const std::vector<Point> &points) {
+    std::ostringstream out;
+    out.precision(10);
+    out << "{\"spots\": [";
+    for (size_t i = 0; i < points.size(); ++i) {
+        out << (i ? ", " : "") << "{\"x\": " << points[i].x << ", \"y\": " << points[i].y << "}";
+    }
+    out << "]}";
+    return out.str();
+}
+
+SDL_Surface *benchSurface() {
+    return SDL_CreateRGBSurfaceWithFormat(0, BENCH_WIDTH, BENCH_HEIGHT, 32, SDL_PIXELFORMAT_RGBA32);
+}
+
+// pixels/s for any stage that touches the whole image, and site_pixels/s for renders of sites.
+void setRenderCounters(benchmark::State &state, size_t sites = 0) {
+    double pixels = static_cast<double>(BENCH_WIDTH) * BENCH_HEIGHT * state.iterations();
+    state.counters["pixels/s"] = benchmark::Counter(pixels, benchmark::Counter::kIsRate);
+    if (sites > 0) {
+        state.counters["site_pixels/s"] = benchmark::Counter(pixels * sites, benchmark::Counter::kIsRate);
+    }
+}
+
+// Site counts 10, 100, ..., 10^6 for every point set kind.
+void allSets(benchmark::internal::Benchmark *b) {
+    for (int kind: {UNIFORM, CLUSTERED, GRIDDED}) {
+        for (int n = 10; n <= 1000000; n *= 10) {
+            b->Args({kind, n});
+        }
+    }
+}
+
+void BM_LoadDom(benchmark::State &state) {
+    std::string text = spotsJson(makePoints(UNIFORM, static_cast<int>(state.range(0)), BENCH_WIDTH, BENCH_HEIGHT));
+    for (auto _: state) {
+        std::istringstream in(text);
+        benchmark::DoNotOptimize(parseSpotsDom(in));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+
+void BM_LoadStream(benchmark::State &state) {
+    std::string text = spotsJson(makePoints(UNIFORM, static_cast<int>(state.range(0)), BENCH_WIDTH, BENCH_HEIGHT));
+    for (auto _: state) {
+        std::istringstream in(text);
+        std::vector<Point> points;
+        std::string error;
+        if (!streamSpots(in, points, error)) state.SkipWithError(error.c_str());
+        benchmark::DoNotOptimize(points);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+
+// Site colors mapped to the surface format, then every pixel painted from a label buffer.
+void BM_MapColors(benchmark::State &state) {
+    int n = static_cast<int>(state.range(0));
+    std::vector<Point> points = makePoints(UNIFORM, n, BENCH_WIDTH, BENCH_HEIGHT);
+    std::vector<int> labels(static_cast<size_t>(BENCH_WIDTH) * BENCH_HEIGHT);
+    for (size_t i = 0; i < labels.size(); ++i) {
+        labels[i] = static_cast<int>(i / 64 % n);
+    }
+    SDL_Surface *surface = benchSurface();
+    for (auto _: state) {
+        paintLabels(surface, labels, mapSiteColors(surface, points));
+        benchmark::ClobberMemory();
+    }
+    SDL_FreeSurface(surface);
+    setRenderCounters(state);
+}
+
+template<class M>
+void BM_Render(benchmark::State &state) {
+    int kind = static_cast<int>(state.range(0));
+    std::vector<Point> points = makePoints(kind, static_cast<int>(state.range(1)), BENCH_WIDTH, BENCH_HEIGHT);
+    RenderOptions options;
+    options.width = BENCH_WIDTH;
+    options.height = BENCH_HEIGHT;
+    options.threads = 1;
+    options.verbose = false;
+    std::vector<Point> pixels = toPixelSpace(points, options.view);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(computeLabels<M>(pixels, options));
+    }
+    state.SetLabel(pointSetName(kind));
+    setRenderCounters(state, points.size());
+}
+
+// Euclidean render with each search mode; brute force and the SIMD scan stop at 10^4 sites.
+void BM_RenderMode(benchmark::State &state) {
+    RenderOptions options;
+    options.mode = static_cast<SearchMode>(state.range(0));
+    options.width = BENCH_WIDTH;
+    options.height = BENCH_HEIGHT;
+    options.threads = 1;
+    options.verbose = false;
+    std::vector<Point> points = makePoints(UNIFORM, static_cast<int>(state.range(1)), BENCH_WIDTH, BENCH_HEIGHT);
+    std::vector<Point> pixels = toPixelSpace(points, options.view);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(computeLabels<EuclideanMetric>(pixels, options));
+    }
+    state.SetLabel(searchModeName(options.mode));
+    setRenderCounters(state, points.size());
+}
+
+void renderModes(benchmark::internal::Benchmark *b) {
+    for (SearchMode mode: {SearchMode::BRUTE_FORCE, SearchMode::GRID, SearchMode::SIMD, SearchMode::SCANLINE,
+                           SearchMode::FORTUNE, SearchMode::JUMP_FLOOD, SearchMode::QUADTREE}) {
+        int limit = (mode == SearchMode::BRUTE_FORCE || mode == SearchMode::SIMD) ? 10000 : 1000000;
+        for (int n = 10; n <= limit; n *= 10) {
+            b->Args({static_cast<int>(mode), n});
+        }
+    }
+}
+
+void BM_DrawSpots(benchmark::State &state) {
+    std::vector<Point> points = makePoints(UNIFORM, static_cast<int>(state.range(0)), BENCH_WIDTH, BENCH_HEIGHT);
+    SDL_Surface *surface = benchSurface();
+    SDL_Color spotColor = {0, 0, 0, 255};
+    for (auto _: state) {
+        for (const auto &p: points) {
+            drawSpot(surface, static_cast<int>(p.x), static_cast<int>(p.y), spotColor);
+        }
+        benchmark::ClobberMemory();
+    }
+    SDL_FreeSurface(surface);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Encodes a rendered image; more sites mean shorter runs and a harder image to compress. The
+// encoder runs on its own threads, so this one is timed by the wall clock.
+void BM_SavePng(benchmark::State &state) {
+    int kind = static_cast<int>(state.range(0));
+    std::vector<Point> points = makePoints(kind, static_cast<int>(state.range(1)), BENCH_WIDTH, BENCH_HEIGHT);
+    RenderOptions options;
+    options.width = BENCH_WIDTH;
+    options.height = BENCH_HEIGHT;
+    options.verbose = false;
+    SDL_Surface *surface = benchSurface();
+    paintLabels(surface, computeLabels<EuclideanMetric>(points, options), mapSiteColors(surface, points));
+    std::string path = "bench_" + std::to_string(kind) + "_" + std::to_string(state.range(1)) + ".png";
+    for (auto _: state) {
+        if (!savePng(surface, path, options.threads)) state.SkipWithError("failed to write the PNG");
+    }
+    std::remove(path.c_str());
+    SDL_FreeSurface(surface);
+    state.SetLabel(pointSetName(kind));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(BENCH_WIDTH) * BENCH_HEIGHT * 4);
+    setRenderCounters(state);
+}
+
+BENCHMARK(BM_LoadDom)->RangeMultiplier(10)->Range(10, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoadStream)->RangeMultiplier(10)->Range(10, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MapColors)->RangeMultiplier(10)->Range(10, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Render, EuclideanMetric)->Apply(allSets)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Render, ManhattanMetric)->Apply(allSets)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Render, ChebyshevMetric)->Apply(allSets)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Render, LpMetric<3>)->Apply(allSets)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Render, PowerMetric)->Apply(allSets)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Render, AdditiveMetric)->Apply(allSets)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RenderMode)->Apply(renderModes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DrawSpots)->RangeMultiplier(10)->Range(10, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SavePng)->Apply(allSets)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,537 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+#include "point.h"
+
+// Neighbours of every site in compressed form: the neighbours of site i are
+// neighbors[offsets[i]] .. neighbors[offsets[i + 1] - 1].
+struct SiteAdjacency {
+    std::vector<int> offsets;
+    std::vector<int> neighbors;
+};
+
+// Delaunay triangulation of the sites, the dual of the Euclidean Voronoi diagram. Built with a
+// radial sweep: sites are added in order of distance from a seed triangle, each one lands outside
+// the current convex hull, is joined to the hull edges it can see (found through a hash on the
+// angle around the seed) and the new triangles are made Delaunay by edge flips. Sorting
+// dominates, so a build is O(n log n); a million sites take about a second.
+//
+// Triangles are stored as vertex triples in `triangles`, counterclockwise with y up; halfedge
+// h runs from triangles[h] to the next vertex of its triangle and halfedges[h] is the opposite
+// halfedge in the neighbouring triangle, or -1 on the convex hull. Vertex indices are site
+// indices. A site that coincides with an earlier one is left out of the triangulation and has no
+// neighbours.
+//
+// insert() adds one more site incrementally: a walk from the last triangle finds the triangle
+// that contains it (split into three, or four when the site lies on an edge) or the hull edge it
+// sees (joined like a sweep step), and flips restore the Delaunay property locally.
+class Delaunay {
+public:
+    std::vector<int> triangles;
+    std::vector<int> halfedges;
+
+    explicit Delaunay(const std::vector<Point> &points) {
+        coords.reserve(points.size() * 2);
+        for (const auto &p: points) {
+            coords.push_back(p.x);
+            coords.push_back(p.y);
+        }
+        build();
+    }
+
+    int size() const {
+        return static_cast<int>(coords.size() / 2);
+    }
+
+    // Adds a site and returns its index, which is the next site index.
+    int insert(double x, double y) {
+        int i = size();
+        coords.push_back(x);
+        coords.push_back(y);
+        hullPrev.push_back(i);
+        hullNext.push_back(i);
+        hullTri.push_back(-1);
+        if (triangles.empty()) {
+            // Fewer than three sites or all on one line so far: nothing to walk.
+            build();
+            return i;
+        }
+
+        int edge = -1;
+        int t = locate(x, y, edge);
+        if (t < 0) {
+            // Outside the hull; -t - 1 is a hull halfedge the site sees.
+            int e = triangles[-t - 1];
+            addOutside(i, e, true);
+            hullHash[hashKey(coords[2 * e], coords[2 * e + 1])] = e;
+            return i;
+        }
+        for (int k = 0; k < 3; ++k) {
+            int v = triangles[t + k];
+            if (std::abs(coords[2 * v] - x) <= EPSILON && std::abs(coords[2 * v + 1] - y) <= EPSILON) return i;
+        }
+        if (edge == -1) {
+            splitTriangle(i, t);
+        } else {
+            splitEdge(i, edge);
+        }
+        return i;
+    }
+
+    // Delaunay neighbours of every site. Collinear sites are chained along their line.
+    SiteAdjacency adjacency() const {
+        int n = size();
+        SiteAdjacency result;
+        result.offsets.assign(n + 1, 0);
+        auto forEachEdge = [&](auto &&visit) {
+            if (triangles.empty()) {
+                for (size_t k = 1; k < chain.size(); ++k) {
+                    visit(chain[k - 1], chain[k]);
+                    visit(chain[k], chain[k - 1]);
+                }
+                return;
+            }
+            for (size_t h = 0; h < triangles.size(); ++h) {
+                int from = triangles[h];
+                int to = triangles[nextHalfedge(static_cast<int>(h))];
+                visit(from, to);
+                if (halfedges[h] == -1) visit(to, from);
+            }
+        };
+        forEachEdge([&](int from, int) { ++result.offsets[from + 1]; });
+        std::partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+        result.neighbors.resize(result.offsets[n]);
+        std::vector<int> fill(result.offsets.begin(), result.offsets.end() - 1);
+        forEachEdge([&](int from, int to) { result.neighbors[fill[from]++] = to; });
+        return result;
+    }
+
+private:
+    static constexpr double EPSILON = std::numeric_limits<double>::epsilon();
+
+    std::vector<double> coords;
+    std::vector<int> hullPrev, hullNext, hullTri, hullHash;
+    std::vector<int> chain;
+    std::vector<int> edgeStack;
+    int hullStart = 0;
+    int lastTriangle = 0;
+    std::vector<int> startCells;
+    int cellsPerSide = 1;
+    double cellMinX = 0, cellMinY = 0, cellSize = 1;
+    double cx = 0, cy = 0;
+
+    static int nextHalfedge(int h) {
+        return h % 3 == 2 ? h - 2 : h + 1;
+    }
+
+    static int prevHalfedge(int h) {
+        return h % 3 == 0 ? h + 2 : h - 1;
+    }
+
+    // Positive when c is to the left of a->b.
+    double orient(int a, int b, double x, double y) const {
+        double ax = coords[2 * a], ay = coords[2 * a + 1];
+        return (coords[2 * b] - ax) * (y - ay) - (coords[2 * b + 1] - ay) * (x - ax);
+    }
+
+    double orient(int a, int b, int c) const {
+        return orient(a, b, coords[2 * c], coords[2 * c + 1]);
+    }
+
+    // True when d is strictly inside the circumcircle of the counterclockwise triangle abc.
+    bool inCircle(int a, int b, int c, int d) const {
+        double px = coords[2 * d], py = coords[2 * d + 1];
+        double dx = coords[2 * a] - px, dy = coords[2 * a + 1] - py;
+        double ex = coords[2 * b] - px, ey = coords[2 * b + 1] - py;
+        double fx = coords[2 * c] - px, fy = coords[2 * c + 1] - py;
+        double ap = dx * dx + dy * dy, bp = ex * ex + ey * ey, cp = fx * fx + fy * fy;
+        return dx * (ey * cp - bp * fy) - dy * (ex * cp - bp * fx) + ap * (ex * fy - ey * fx) > 0;
+    }
+
+    // Offset of the circumcentre of abc from a.
+    void circumOffset(int a, int b, int c, double &x, double &y) const {
+        double dx = coords[2 * b] - coords[2 * a], dy = coords[2 * b + 1] - coords[2 * a + 1];
+        double ex = coords[2 * c] - coords[2 * a], ey = coords[2 * c + 1] - coords[2 * a + 1];
+        double bl = dx * dx + dy * dy, cl = ex * ex + ey * ey;
+        double d = 0.5 / (dx * ey - dy * ex);
+        x = (ey * bl - dy * cl) * d;
+        y = (dx * cl - ex * bl) * d;
+    }
+
+    // Monotone in the angle of (x, y) around the seed centre, in [0, 1).
+    int hashKey(double x, double y) const {
+        double dx = x - cx, dy = y - cy;
+        double sum = std::abs(dx) + std::abs(dy);
+        double p = sum > 0 ? dx / sum : 0;
+        double angle = (dy > 0 ? 3 - p : 1 + p) / 4;
+        int size = static_cast<int>(hullHash.size());
+        return static_cast<int>(std::floor(angle * size)) % size;
+    }
+
+    // Start grid: cells of about four sites over the bounding box of the build, each remembering
+    // a triangle that had a vertex in it. Flips can leave the entry pointing at a triangle that
+    // has since moved away, which only lengthens the walk. Points outside the box use the
+    // nearest border cell.
+    int cellOf(double x, double y) const {
+        int cx = static_cast<int>(std::clamp((x - cellMinX) / cellSize, 0.0, cellsPerSide - 1.0));
+        int cy = static_cast<int>(std::clamp((y - cellMinY) / cellSize, 0.0, cellsPerSide - 1.0));
+        return cy * cellsPerSide + cx;
+    }
+
+    void recordStart(int t) {
+        int v = triangles[t];
+        startCells[cellOf(coords[2 * v], coords[2 * v + 1])] = t;
+        lastTriangle = t;
+    }
+
+    void link(int a, int b) {
+        halfedges[a] = b;
+        if (b != -1) halfedges[b] = a;
+    }
+
+    // Links a to b, or records a as the hull edge leaving its start vertex when b is -1.
+    void linkOrHull(int a, int b) {
+        link(a, b);
+        if (b == -1) hullTri[triangles[a]] = a;
+    }
+
+    int addTriangle(int i0, int i1, int i2, int a, int b, int c) {
+        int t = static_cast<int>(triangles.size());
+        triangles.push_back(i0);
+        triangles.push_back(i1);
+        triangles.push_back(i2);
+        halfedges.resize(triangles.size(), -1);
+        link(t, a);
+        link(t + 1, b);
+        link(t + 2, c);
+        recordStart(t);
+        return t;
+    }
+
+    void setTriangle(int t, int i0, int i1, int i2) {
+        triangles[t] = i0;
+        triangles[t + 1] = i1;
+        triangles[t + 2] = i2;
+        recordStart(t);
+    }
+
+    void build() {
+        int n = size();
+        triangles.clear();
+        halfedges.clear();
+        chain.clear();
+        hullPrev.assign(n, 0);
+        hullNext.assign(n, 0);
+        hullTri.assign(n, -1);
+        if (n == 0) return;
+
+        double minX = coords[0], minY = coords[1], maxX = coords[0], maxY = coords[1];
+        for (int i = 0; i < n; ++i) {
+            minX = std::min(minX, coords[2 * i]);
+            minY = std::min(minY, coords[2 * i + 1]);
+            maxX = std::max(maxX, coords[2 * i]);
+            maxY = std::max(maxY, coords[2 * i + 1]);
+        }
+        double midX = (minX + maxX) / 2, midY = (minY + maxY) / 2;
+        auto dist2 = [&](int i, double x, double y) {
+            double dx = coords[2 * i] - x, dy = coords[2 * i + 1] - y;
+            return dx * dx + dy * dy;
+        };
+
+        // Seed triangle: the site nearest the middle, its nearest site, and the site that makes
+        // the smallest circumcircle with them.
+        int i0 = 0, i1 = -1, i2 = -1;
+        for (int i = 1; i < n; ++i) {
+            if (dist2(i, midX, midY) < dist2(i0, midX, midY)) i0 = i;
+        }
+        double best = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < n; ++i) {
+            double d = dist2(i, coords[2 * i0], coords[2 * i0 + 1]);
+            if (i != i0 && d > 0 && d < best) {
+                best = d;
+                i1 = i;
+            }
+        }
+        best = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < n && i1 != -1; ++i) {
+            if (i == i0 || i == i1) continue;
+            double x, y;
+            circumOffset(i0, i1, i, x, y);
+            double r = x * x + y * y;
+            if (r < best) {
+                best = r;
+                i2 = i;
+            }
+        }
+
+        std::vector<int> ids(n);
+        std::iota(ids.begin(), ids.end(), 0);
+        std::vector<double> dists(n);
+        if (i2 == -1) {
+            // Every site is on one line (or there are fewer than three): chain them along it.
+            for (int i = 0; i < n; ++i) {
+                dists[i] = coords[2 * i] - coords[0] != 0 ? coords[2 * i] - coords[0] : coords[2 * i + 1] - coords[1];
+            }
+            std::sort(ids.begin(), ids.end(), [&](int a, int b) { return dists[a] < dists[b]; });
+            for (int k = 0; k < n; ++k) {
+                if (k == 0 || dists[ids[k]] > dists[ids[k - 1]]) chain.push_back(ids[k]);
+            }
+            return;
+        }
+        if (orient(i0, i1, i2) < 0) std::swap(i1, i2);
+
+        double ox, oy;
+        circumOffset(i0, i1, i2, ox, oy);
+        cx = coords[2 * i0] + ox;
+        cy = coords[2 * i0 + 1] + oy;
+        for (int i = 0; i < n; ++i) {
+            dists[i] = dist2(i, cx, cy);
+        }
+        std::sort(ids.begin(), ids.end(), [&](int a, int b) { return dists[a] < dists[b]; });
+
+        hullHash.assign(static_cast<size_t>(std::ceil(std::sqrt(n))), -1);
+        hullStart = i0;
+        hullNext[i0] = hullPrev[i2] = i1;
+        hullNext[i1] = hullPrev[i0] = i2;
+        hullNext[i2] = hullPrev[i1] = i0;
+        hullTri[i0] = 0;
+        hullTri[i1] = 1;
+        hullTri[i2] = 2;
+        hullHash[hashKey(coords[2 * i0], coords[2 * i0 + 1])] = i0;
+        hullHash[hashKey(coords[2 * i1], coords[2 * i1 + 1])] = i1;
+        hullHash[hashKey(coords[2 * i2], coords[2 * i2 + 1])] = i2;
+        cellsPerSide = std::max(1, static_cast<int>(std::sqrt(n / 4.0)));
+        cellMinX = minX;
+        cellMinY = minY;
+        cellSize = std::max(std::max(maxX - minX, maxY - minY) / cellsPerSide, EPSILON);
+        startCells.assign(static_cast<size_t>(cellsPerSide) * cellsPerSide, -1);
+        triangles.reserve(static_cast<size_t>(std::max(2 * n - 5, 1)) * 3);
+        halfedges.reserve(triangles.capacity());
+        addTriangle(i0, i1, i2, -1, -1, -1);
+
+        double xp = 0, yp = 0;
+        for (int k = 0; k < n; ++k) {
+            int i = ids[k];
+            double x = coords[2 * i], y = coords[2 * i + 1];
+            if (k > 0 && std::abs(x - xp) <= EPSILON && std::abs(y - yp) <= EPSILON) continue;
+            xp = x;
+            yp = y;
+            if (i == i0 || i == i1 || i == i2) continue;
+
+            // Every site so far is nearer the centre, so this one is outside the hull. The hash
+            // gives a hull vertex at about its angle; walk forward to an edge it can see.
+            int start = 0;
+            int key = hashKey(x, y);
+            for (size_t j = 0; j < hullHash.size(); ++j) {
+                start = hullHash[(key + j) % hullHash.size()];
+                if (start != -1 && start != hullNext[start]) break;
+            }
+            start = hullPrev[start];
+            int e = start;
+            while (orient(e, hullNext[e], x, y) >= 0) {
+                e = hullNext[e];
+                if (e == start) {
+                    e = -1;
+                    break;
+                }
+            }
+            if (e == -1) continue; // a near-duplicate the distance check missed
+
+            addOutside(i, e, e == start);
+            hullHash[hashKey(coords[2 * e], coords[2 * e + 1])] = e;
+        }
+    }
+
+    // Joins site i, outside the hull, to every hull edge it sees, starting from the visible edge
+    // leaving hull vertex e and walking forward, then backward when earlier edges may be
+    // visible too. Leaves e as the hull vertex before i.
+    void addOutside(int i, int &e, bool walkBack) {
+        double x = coords[2 * i], y = coords[2 * i + 1];
+        int t = addTriangle(e, i, hullNext[e], -1, -1, hullTri[e]);
+        hullTri[i] = legalize(t + 2);
+        hullTri[e] = t;
+
+        int n = hullNext[e];
+        for (int q = hullNext[n]; orient(n, q, x, y) < 0; q = hullNext[n]) {
+            t = addTriangle(n, i, q, hullTri[i], -1, hullTri[n]);
+            hullTri[i] = legalize(t + 2);
+            hullNext[n] = n; // removed from the hull
+            n = q;
+        }
+        if (walkBack) {
+            for (int q = hullPrev[e]; orient(q, e, x, y) < 0; q = hullPrev[e]) {
+                t = addTriangle(q, i, e, -1, hullTri[e], hullTri[q]);
+                legalize(t + 2);
+                hullTri[q] = t;
+                hullNext[e] = e;
+                e = q;
+            }
+        }
+
+        hullStart = hullPrev[i] = e;
+        hullNext[e] = hullPrev[n] = i;
+        hullNext[i] = n;
+        hullHash[hashKey(x, y)] = i;
+    }
+
+    // Flips the edge a and, recursively, the edges it exposes until the triangles around it are
+    // Delaunay. The new site is the vertex of a's triangle opposite a. Returns the halfedge that
+    // leaves the new site along the far side, which the sweep keeps as a hull edge.
+    int legalize(int a) {
+        edgeStack.clear();
+        int ar = 0;
+        for (;;) {
+            int b = halfedges[a];
+            int a0 = a - a % 3;
+            ar = a0 + (a + 2) % 3;
+            if (b == -1) {
+                if (edgeStack.empty()) break;
+                a = edgeStack.back();
+                edgeStack.pop_back();
+                continue;
+            }
+            int b0 = b - b % 3;
+            int al = a0 + (a + 1) % 3;
+            int bl = b0 + (b + 2) % 3;
+            int p0 = triangles[ar];
+            int pr = triangles[a];
+            int pl = triangles[al];
+            int p1 = triangles[bl];
+
+            if (inCircle(p0, pr, pl, p1)) {
+                triangles[a] = p1;
+                triangles[b] = p0;
+                int hbl = halfedges[bl];
+                if (hbl == -1) {
+                    // The flip moved a hull edge to a different halfedge.
+                    int e = hullStart;
+                    do {
+                        if (hullTri[e] == bl) {
+                            hullTri[e] = a;
+                            break;
+                        }
+                        e = hullPrev[e];
+                    } while (e != hullStart);
+                }
+                int har = halfedges[ar];
+                if (har == -1) {
+                    // Likewise for the hull edge leaving the new site, when it has one.
+                    hullTri[p0] = b;
+                }
+                link(a, hbl);
+                link(b, har);
+                link(ar, bl);
+                edgeStack.push_back(b0 + (b + 1) % 3);
+            } else {
+                if (edgeStack.empty()) break;
+                a = edgeStack.back();
+                edgeStack.pop_back();
+            }
+        }
+        return ar;
+    }
+
+    // Walks from a triangle recorded for the point's cell of the start grid towards (x, y),
+    // crossing an edge the point is to the right of; cells hold a few sites each, so walks are
+    // short whatever the insertion order. Returns the first halfedge of the containing triangle,
+    // with edge set to the halfedge the point lies on (or -1), or -h - 1 for a hull halfedge h
+    // that sees the point. The starting edge rotates between steps so the walk cannot cycle; a
+    // walk that runs too long (possible only through rounding) falls back to checking every
+    // triangle.
+    int locate(double x, double y, int &edge) {
+        int t = startCells[cellOf(x, y)];
+        if (t == -1) t = lastTriangle;
+        int steps = 0;
+        int limit = static_cast<int>(triangles.size());
+        for (int rotate = 0; steps < limit; ++steps, ++rotate) {
+            bool moved = false;
+            for (int k = 0; k < 3 && !moved; ++k) {
+                int h = t + (k + rotate) % 3;
+                if (orient(triangles[h], triangles[nextHalfedge(h)], x, y) < 0) {
+                    if (halfedges[h] == -1) return -h - 1;
+                    t = halfedges[h] - halfedges[h] % 3;
+                    moved = true;
+                }
+            }
+            if (!moved) break;
+        }
+        if (steps == limit) {
+            for (t = 0; t < static_cast<int>(triangles.size()); t += 3) {
+                bool inside = true;
+                for (int k = 0; k < 3 && inside; ++k) {
+                    inside = orient(triangles[t + k], triangles[nextHalfedge(t + k)], x, y) >= 0;
+                }
+                if (inside) break;
+            }
+            if (t == static_cast<int>(triangles.size())) {
+                for (int e = hullStart;; e = hullNext[e]) {
+                    if (orient(e, hullNext[e], x, y) < 0) return -hullTri[e] - 1;
+                }
+            }
+        }
+        edge = -1;
+        for (int k = 0; k < 3; ++k) {
+            if (orient(triangles[t + k], triangles[nextHalfedge(t + k)], x, y) == 0) edge = t + k;
+        }
+        return t;
+    }
+
+    // Site i inside triangle t: t becomes (a, b, i) and two new triangles take the other edges.
+    void splitTriangle(int i, int t) {
+        int a = triangles[t], b = triangles[t + 1], c = triangles[t + 2];
+        int ha = halfedges[t], hb = halfedges[t + 1], hc = halfedges[t + 2];
+        setTriangle(t, a, b, i);
+        int t2 = addTriangle(b, c, i, -1, -1, t + 1);
+        int t3 = addTriangle(c, a, i, -1, t + 2, t2 + 1);
+        linkOrHull(t, ha);
+        linkOrHull(t2, hb);
+        linkOrHull(t3, hc);
+        legalize(t);
+        legalize(t2);
+        legalize(t3);
+    }
+
+    // Site i on halfedge e (a->b, opposite c): both triangles sharing the edge split in two, or
+    // just the one when e is on the hull, which then gains i between a and b.
+    void splitEdge(int i, int e) {
+        int a = triangles[e], b = triangles[nextHalfedge(e)], c = triangles[prevHalfedge(e)];
+        int f = halfedges[e];
+        int h1 = halfedges[nextHalfedge(e)], h2 = halfedges[prevHalfedge(e)];
+        int t = e - e % 3;
+
+        setTriangle(t, a, i, c);
+        int tb = addTriangle(i, b, c, -1, -1, t + 1);
+        linkOrHull(t + 2, h2);
+        linkOrHull(tb + 1, h1);
+        if (f == -1) {
+            link(t, -1);
+            link(tb, -1);
+            hullNext[a] = i;
+            hullPrev[i] = a;
+            hullNext[i] = b;
+            hullPrev[b] = i;
+            hullTri[a] = t;
+            hullTri[i] = tb;
+            legalize(t + 2);
+            legalize(tb + 1);
+            return;
+        }
+
+        int d = triangles[prevHalfedge(f)];
+        int h3 = halfedges[nextHalfedge(f)], h4 = halfedges[prevHalfedge(f)];
+        int u = f - f % 3;
+        setTriangle(u, b, i, d);
+        int ud = addTriangle(i, a, d, t, -1, u + 1);
+        link(u, tb);
+        linkOrHull(u + 2, h4);
+        linkOrHull(ud + 1, h3);
+        legalize(t + 2);
+        legalize(tb + 1);
+        legalize(u + 2);
+        legalize(ud + 1);
+    }
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <SDL.h>
+#include <vector>
+#include "point.h"
+#include "profile.h"
+
+// Calls paint(index) for every pixel of the spot disc that lies inside a width x height image.
+template<class F>
+void forSpotPixels(int width, int height, int centerX, int centerY, F &&paint) {
+    for (int y = -SPOT_RADIUS; y <= SPOT_RADIUS; ++y) {
+        for (int x = -SPOT_RADIUS; x <= SPOT_RADIUS; ++x) {
+            if (x * x + y * y <= SPOT_RADIUS * SPOT_RADIUS) {
+                int drawX = centerX + x;
+                int drawY = centerY + y;
+
+                if (drawX >= 0 && drawX < width && drawY >= 0 && drawY < height) {
+                    paint(static_cast<size_t>(drawY) * width + drawX);
+                }
+            }
+        }
+    }
+}
+
+void drawSpot(SDL_Surface *surface, int centerX, int centerY, SDL_Color color) {
+    Uint32 pixelColor = SDL_MapRGBA(surface->format, color.r, color.g, color.b, color.a);
+    Uint32 *pixels = static_cast<Uint32 *>(surface->pixels);
+    forSpotPixels(surface->w, surface->h, centerX, centerY, [&](size_t i) { pixels[i] = pixelColor; });
+}
+
+std::vector<Uint32> mapSiteColors(const SDL_Surface *surface, const std::vector<Point> &points) {
+    std::vector<Uint32> siteColors;
+    siteColors.reserve(points.size());
+    for (const auto &p: points) {
+        siteColors.push_back(SDL_MapRGBA(surface->format, p.color.r, p.color.g, p.color.b, p.color.a));
+    }
+    return siteColors;
+}
+
+// Colors the first labels.size() pixels of the surface by site, opaque black where there is none.
+void paintLabels(SDL_Surface *surface, const std::vector<int> &labels, const std::vector<Uint32> &siteColors) {
+    PROFILE_STAGE("paint");
+    Uint32 *pixels = static_cast<Uint32 *>(surface->pixels);
+    Uint32 noSiteColor = SDL_MapRGBA(surface->format, 0, 0, 0, 255);
+    for (size_t i = 0; i < labels.size(); ++i) {
+        pixels[i] = (labels[i] < 0) ? noSiteColor : siteColors[labels[i]];
+    }
+}
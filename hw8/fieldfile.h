@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Raw per-pixel output for tools that need more than colors: a fixed header followed by
+// width * height values in row order, starting on a 16-byte offset so the file can be mapped
+// and used in place. FIELD_LABELS holds uint32 site indices (0xFFFFFFFF where no site is in
+// range); FIELD_DISTANCES holds float32 distances to that site in world units (infinity where
+// there is none). The header keeps the view, so pixel (x, y) samples the world point
+// (originX + x * scale, originY + y * scale).
+const uint32_t FIELD_FILE_MAGIC = 0x444C4656; // "VFLD" little-endian
+const uint32_t FIELD_FILE_VERSION = 1;
+const uint32_t FIELD_LABELS = 1;
+const uint32_t FIELD_DISTANCES = 2;
+
+struct FieldFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+    double originX, originY, scale;
+};
+
+static_assert(sizeof(FieldFileHeader) == 48, "FieldFileHeader must stay packed to 48 bytes");
+
+// Streams a field file a band of rows at a time; values are written in the order they arrive.
+class FieldWriter {
+public:
+    bool open(const std::string &path, uint32_t kind, int width, int height,
+              double originX, double originY, double scale) {
+        out.open(path, std::ios::binary);
+        if (!out.is_open()) return false;
+        FieldFileHeader header{};
+        header.magic = FIELD_FILE_MAGIC;
+        header.version = FIELD_FILE_VERSION;
+        header.kind = kind;
+        header.width = static_cast<uint32_t>(width);
+        header.height = static_cast<uint32_t>(height);
+        header.originX = originX;
+        header.originY = originY;
+        header.scale = scale;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        return out.good();
+    }
+
+    bool isOpen() const {
+        return out.is_open();
+    }
+
+    template<class T>
+    bool write(const T *values, size_t count) {
+        out.write(reinterpret_cast<const char *>(values), static_cast<std::streamsize>(count * sizeof(T)));
+        return out.good();
+    }
+
+    bool close() {
+        out.close();
+        return !out.fail();
+    }
+
+private:
+    std::ofstream out;
+};
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <queue>
+#include <set>
+#include <vector>
+#include "metrics.h"
+
+struct Vec2 {
+    double x, y;
+};
+
+struct VoronoiCell {
+    int site;
+    std::vector<Vec2> polygon;
+};
+
+// Fortune's sweep over x. The beach line is a multiset of arcs ordered by the y of their upper
+// breakpoint at the current sweep position; the order of existing arcs never changes while the
+// sweep advances, so the set stays valid. Every arc boundary that appears is a Delaunay edge,
+// which is all the cell construction below needs. The sweep position belongs to the instance
+// and the beach line's comparator points at it, so sweeps on different threads never meet.
+struct FortuneSweep {
+    using ld = long double;
+
+    struct P {
+        ld x, y;
+    };
+
+    static constexpr ld INF = 1e30L;
+    static constexpr ld EPS = 1e-12L;
+
+    struct Arc {
+        mutable P p, q;
+        mutable int id = 0;
+        int i;
+
+        Arc(P p, P q, int i) : p(p), q(q), i(i) {}
+
+        ld breakpointY(ld x) const {
+            if (q.y == INF) return INF;
+            x += EPS;
+            ld mx = (p.x + q.x) / 2, my = (p.y + q.y) / 2;
+            ld dx = -(p.y - q.y), dy = p.x - q.x;
+            ld d = (x - p.x) * (x - q.x);
+            return my + ((mx - x) * dx + std::sqrt(std::max(d, ld(0))) * std::hypot(dx, dy)) / dy;
+        }
+    };
+
+    // Orders arcs, and looks them up by y, at the owning sweep's current position.
+    struct ArcOrder {
+        using is_transparent = void;
+        const ld *sweepX;
+
+        bool operator()(const Arc &a, const ld &y) const {
+            return a.breakpointY(*sweepX) < y;
+        }
+
+        bool operator()(const ld &y, const Arc &a) const {
+            return y < a.breakpointY(*sweepX);
+        }
+
+        bool operator()(const Arc &a, const Arc &b) const {
+            return a.breakpointY(*sweepX) < b.breakpointY(*sweepX);
+        }
+    };
+
+    using BeachLine = std::multiset<Arc, ArcOrder>;
+
+    struct Event {
+        ld x;
+        int id;
+        typename BeachLine::iterator it;
+
+        bool operator<(const Event &other) const {
+            return x > other.x;
+        }
+    };
+
+    ld sweepX = 0;
+    BeachLine line{ArcOrder{&sweepX}};
+    std::vector<P> sorted;
+    std::vector<int> original;
+    std::priority_queue<Event> events;
+    std::vector<bool> valid;
+    std::vector<std::pair<int, int>> edges;
+    int nextId = 0;
+
+    FortuneSweep() = default;
+    FortuneSweep(const FortuneSweep &) = delete;
+    FortuneSweep &operator=(const FortuneSweep &) = delete;
+
+    static ld cross(P a, P b, P c) {
+        return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    }
+
+    void addEdge(int i, int j) {
+        if (i == -1 || j == -1) return;
+        edges.emplace_back(original[i], original[j]);
+    }
+
+    void updateCircle(typename BeachLine::iterator it) {
+        if (it->i == -1) return;
+        valid[-it->id] = false;
+        auto a = std::prev(it);
+        P u = a->p, v = it->p, w = it->q;
+        ld scale = std::hypot(v.x - w.x, v.y - w.y) * std::hypot(u.x - w.x, u.y - w.y);
+        // Collinear triples have no circle; rounding must not turn them into a far-away event.
+        if (cross(w, v, u) > scale * 1e-12L) {
+            ld d = 2 * (u.x * (v.y - w.y) + v.x * (w.y - u.y) + w.x * (u.y - v.y));
+            ld uu = u.x * u.x + u.y * u.y, vv = v.x * v.x + v.y * v.y, ww = w.x * w.x + w.y * w.y;
+            ld cx = (uu * (v.y - w.y) + vv * (w.y - u.y) + ww * (u.y - v.y)) / d;
+            ld cy = (uu * (w.x - v.x) + vv * (u.x - w.x) + ww * (v.x - u.x)) / d;
+            it->id = --nextId;
+            valid.push_back(true);
+            events.push({cx + std::hypot(cx - v.x, cy - v.y), it->id, it});
+        }
+    }
+
+    void addSite(int i) {
+        P p = sorted[i];
+        auto c = line.lower_bound(p.y);
+        auto b = line.insert(c, Arc(p, c->p, i));
+        auto a = line.insert(b, Arc(c->p, p, c->i));
+        addEdge(i, c->i);
+        updateCircle(a);
+        updateCircle(b);
+        updateCircle(c);
+    }
+
+    void removeArc(typename BeachLine::iterator it) {
+        auto a = std::prev(it);
+        auto b = std::next(it);
+        line.erase(it);
+        a->q = b->p;
+        addEdge(a->i, b->i);
+        updateCircle(a);
+        updateCircle(b);
+    }
+
+    // Sites must be distinct; edges come back as pairs of indices into `points`. The sweep runs
+    // in a slightly rotated frame so sites sharing an x (grids, rows of spawns) do not meet the
+    // sweep line at the same instant, which the breakpoint formula cannot resolve.
+    std::vector<std::pair<int, int>> run(const std::vector<Point> &points, const std::vector<int> &ids) {
+        const ld angle = 0.0123L;
+        ld cs = std::cos(angle), sn = std::sin(angle);
+        std::vector<P> rotated(points.size());
+        for (int id: ids) {
+            rotated[id] = {points[id].x * cs - points[id].y * sn, points[id].x * sn + points[id].y * cs};
+        }
+
+        original = ids;
+        std::sort(original.begin(), original.end(), [&](int a, int b) {
+            return rotated[a].x < rotated[b].x || (rotated[a].x == rotated[b].x && rotated[a].y < rotated[b].y);
+        });
+        ld extent = 1;
+        for (int id: original) {
+            sorted.push_back(rotated[id]);
+            extent = std::max({extent, std::abs(sorted.back().x), std::abs(sorted.back().y)});
+        }
+
+        ld sentinel = extent * 1e6L;
+        line.insert(Arc({-sentinel, -sentinel}, {-sentinel, sentinel}, -1));
+        line.insert(Arc({-sentinel, sentinel}, {INF, INF}, -1));
+        for (int i = 0; i < static_cast<int>(sorted.size()); ++i) {
+            events.push({sorted[i].x, i, line.end()});
+        }
+        valid.assign(1, false);
+
+        while (!events.empty()) {
+            Event e = events.top();
+            events.pop();
+            sweepX = e.x;
+            if (e.id >= 0) {
+                addSite(e.id);
+            } else if (valid[-e.id]) {
+                removeArc(e.it);
+            }
+        }
+        return edges;
+    }
+};
+
+// Clips the bounding box against the bisector of every Delaunay neighbour.
+std::vector<Vec2> clipToBisector(const std::vector<Vec2> &polygon, const Point &a, const Point &b) {
+    double nx = b.x - a.x, ny = b.y - a.y;
+    double c = (b.x * b.x + b.y * b.y - a.x * a.x - a.y * a.y) / 2;
+    std::vector<Vec2> result;
+    for (size_t k = 0; k < polygon.size(); ++k) {
+        Vec2 u = polygon[k], v = polygon[(k + 1) % polygon.size()];
+        double du = u.x * nx + u.y * ny - c, dv = v.x * nx + v.y * ny - c;
+        if (du <= 0) result.push_back(u);
+        if ((du < 0 && dv > 0) || (du > 0 && dv < 0)) {
+            double t = du / (du - dv);
+            result.push_back({u.x + (v.x - u.x) * t, u.y + (v.y - u.y) * t});
+        }
+    }
+    return result;
+}
+
+// Exact Euclidean Voronoi cells clipped to [minX, maxX] x [minY, maxY], one entry per site in
+// input order. Duplicate sites keep the lowest index; the others get an empty polygon.
+std::vector<VoronoiCell> voronoiCells(const std::vector<Point> &points, double minX, double minY,
+                                      double maxX, double maxY) {
+    std::vector<int> ids(points.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    std::sort(ids.begin(), ids.end(), [&](int a, int b) {
+        if (points[a].x != points[b].x) return points[a].x < points[b].x;
+        if (points[a].y != points[b].y) return points[a].y < points[b].y;
+        return a < b;
+    });
+    std::vector<int> distinct;
+    for (size_t k = 0; k < ids.size(); ++k) {
+        if (k > 0 && points[ids[k]].x == points[ids[k - 1]].x && points[ids[k]].y == points[ids[k - 1]].y) continue;
+        distinct.push_back(ids[k]);
+    }
+
+    std::vector<std::vector<int>> neighbours(points.size());
+    FortuneSweep sweep;
+    for (const auto &edge: sweep.run(points, distinct)) {
+        neighbours[edge.first].push_back(edge.second);
+        neighbours[edge.second].push_back(edge.first);
+    }
+
+    std::vector<VoronoiCell> cells(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        cells[i].site = static_cast<int>(i);
+    }
+    for (int i: distinct) {
+        std::vector<Vec2> polygon = {{minX, minY}, {maxX, minY}, {maxX, maxY}, {minX, maxY}};
+        for (int j: neighbours[i]) {
+            if (polygon.empty()) break;
+            polygon = clipToBisector(polygon, points[i], points[j]);
+        }
+        cells[i].polygon = polygon;
+    }
+    return cells;
+}
+
+// Scan-converts the cells into a label buffer of height rows sampled at pixel centres, starting
+// at image row firstRow. Cells are filled from the highest index down so a pixel exactly on a
+// shared edge ends up with the lower index.
+// Neighbouring cells are clipped separately, so a shared edge can come out a rounding error
+// apart in each; every test against a row or column is widened by SCAN_EPSILON so such an edge
+// lying on a pixel centre is covered by both cells rather than by neither.
+template<class L>
+void rasterizeCells(const std::vector<VoronoiCell> &cells, int width, int height, std::vector<L> &labels,
+                    int firstRow = 0) {
+    const double SCAN_EPSILON = 1e-7;
+    labels.assign(static_cast<size_t>(width) * height, static_cast<L>(-1));
+    for (auto cell = cells.rbegin(); cell != cells.rend(); ++cell) {
+        const auto &polygon = cell->polygon;
+        if (polygon.size() < 3) continue;
+
+        double top = polygon[0].y, bottom = polygon[0].y;
+        for (const auto &v: polygon) {
+            top = std::min(top, v.y);
+            bottom = std::max(bottom, v.y);
+        }
+        int y0 = std::max(firstRow, static_cast<int>(std::ceil(top - SCAN_EPSILON)));
+        int y1 = std::min(firstRow + height - 1, static_cast<int>(std::floor(bottom + SCAN_EPSILON)));
+
+        for (int y = y0; y <= y1; ++y) {
+            double left = INFINITY, right = -INFINITY;
+            for (size_t k = 0; k < polygon.size(); ++k) {
+                Vec2 u = polygon[k], v = polygon[(k + 1) % polygon.size()];
+                if (y < std::min(u.y, v.y) - SCAN_EPSILON || y > std::max(u.y, v.y) + SCAN_EPSILON) continue;
+                if (std::abs(v.y - u.y) <= SCAN_EPSILON) {
+                    left = std::min({left, u.x, v.x});
+                    right = std::max({right, u.x, v.x});
+                } else {
+                    double t = std::clamp((y - u.y) / (v.y - u.y), 0.0, 1.0);
+                    double x = u.x + (v.x - u.x) * t;
+                    left = std::min(left, x);
+                    right = std::max(right, x);
+                }
+            }
+            int x0 = std::max(0, static_cast<int>(std::ceil(left - SCAN_EPSILON)));
+            int x1 = std::min(width - 1, static_cast<int>(std::floor(right + SCAN_EPSILON)));
+            for (int x = x0; x <= x1; ++x) {
+                labels[static_cast<size_t>(y - firstRow) * width + x] = static_cast<L>(cell->site);
+            }
+        }
+    }
+}
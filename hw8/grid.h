@@ -0,0 +1,329 @@
+#pragma once
+
+#include <vector>
+#include "metrics.h"
+
+// Rectangle size (width + height in cells, minus two) beyond which nearestEach stops sharing strips.
+const int JOINT_SEARCH_SPAN = 6;
+
+struct SiteGrid {
+    double minX = 0, minY = 0;
+    double cellSize = 1;
+    int cols = 0, rows = 0;
+    std::vector<int> cellStart;   // first slot of each cell, plus one past the last slot
+    std::vector<int> cellEnd;     // one past each cell's last site; the slots up to the next cell are spare
+    std::vector<int> sites;
+    std::vector<float> xs, ys, ws;
+    float maxWeight = 0;
+
+    // Sites whose alive flag is false are left out; an empty mask keeps every site. Each cell gets
+    // `spare` free slots after its sites for insert().
+    void build(const std::vector<Point> &points, const std::vector<bool> &alive = {}, int spare = 0) {
+        cellStart.clear();
+        cellEnd.clear();
+        sites.clear();
+        xs.clear();
+        ys.clear();
+        ws.clear();
+        maxWeight = 0;
+        cols = rows = 0;
+
+        std::vector<int> members;
+        for (int i = 0; i < static_cast<int>(points.size()); ++i) {
+            if (alive.empty() || alive[i]) members.push_back(i);
+        }
+        if (members.empty()) return;
+
+        double maxX = points[members[0]].x, maxY = points[members[0]].y;
+        minX = maxX;
+        minY = maxY;
+        maxWeight = static_cast<float>(points[members[0]].weight);
+        for (int i: members) {
+            maxWeight = std::max(maxWeight, static_cast<float>(points[i].weight));
+            minX = std::min(minX, points[i].x);
+            minY = std::min(minY, points[i].y);
+            maxX = std::max(maxX, points[i].x);
+            maxY = std::max(maxY, points[i].y);
+        }
+
+        double w = std::max(maxX - minX, 1.0);
+        double h = std::max(maxY - minY, 1.0);
+        cellSize = std::sqrt(w * h * 2.0 / members.size());
+        cellSize = std::max(cellSize, std::max(w, h) / 4096.0);
+        cols = static_cast<int>(w / cellSize) + 1;
+        rows = static_cast<int>(h / cellSize) + 1;
+
+        cellStart.assign(static_cast<size_t>(cols) * rows + 1, 0);
+        std::vector<int> cellOf(members.size());
+        for (size_t k = 0; k < members.size(); ++k) {
+            cellOf[k] = cellIndex(cellX(points[members[k]].x), cellY(points[members[k]].y));
+            ++cellStart[cellOf[k] + 1];
+        }
+        for (size_t c = 1; c < cellStart.size(); ++c) {
+            cellStart[c] += cellStart[c - 1] + spare;
+        }
+
+        cellEnd.assign(cellStart.begin(), cellStart.end() - 1);
+        sites.assign(cellStart.back(), -1);
+        xs.resize(sites.size());
+        ys.resize(sites.size());
+        ws.resize(sites.size());
+        for (size_t k = 0; k < members.size(); ++k) {
+            int slot = cellEnd[cellOf[k]]++;
+            sites[slot] = members[k];
+            xs[slot] = static_cast<float>(points[members[k]].x);
+            ys[slot] = static_cast<float>(points[members[k]].y);
+            ws[slot] = static_cast<float>(points[members[k]].weight);
+        }
+    }
+
+    // Adds site i at p to its cell in place. Returns false, leaving the grid unchanged, when p
+    // lies outside the grid's cells or its cell has no spare slot; the caller then rebuilds.
+    bool insert(int i, const Point &p) {
+        if (sites.empty()) return false;
+        double fx = std::floor((p.x - minX) / cellSize), fy = std::floor((p.y - minY) / cellSize);
+        if (!(fx >= 0 && fx < cols && fy >= 0 && fy < rows)) return false;
+        int c = cellIndex(static_cast<int>(fx), static_cast<int>(fy));
+        if (cellEnd[c] == cellStart[c + 1]) return false;
+
+        int slot = cellEnd[c]++;
+        sites[slot] = i;
+        xs[slot] = static_cast<float>(p.x);
+        ys[slot] = static_cast<float>(p.y);
+        ws[slot] = static_cast<float>(p.weight);
+        maxWeight = std::max(maxWeight, ws[slot]);
+        return true;
+    }
+
+    // Takes site i, last inserted or built at p, out of its cell. maxWeight is left as it is,
+    // which keeps it an upper bound.
+    void remove(int i, const Point &p) {
+        if (sites.empty()) return;
+        int c = cellIndex(cellX(p.x), cellY(p.y));
+        for (int k = cellStart[c]; k < cellEnd[c]; ++k) {
+            if (sites[k] != i) continue;
+            int last = --cellEnd[c];
+            sites[k] = sites[last];
+            xs[k] = xs[last];
+            ys[k] = ys[last];
+            ws[k] = ws[last];
+            return;
+        }
+    }
+
+    int cellX(double x) const {
+        return std::clamp(static_cast<int>(std::floor((x - minX) / cellSize)), 0, cols - 1);
+    }
+
+    int cellY(double y) const {
+        return std::clamp(static_cast<int>(std::floor((y - minY) / cellSize)), 0, rows - 1);
+    }
+
+    int cellIndex(int cx, int cy) const {
+        return cy * cols + cx;
+    }
+
+    // Best-first block search. The searched cells always form a rectangle, and everything outside
+    // it splits into four blocks: the columns left and right of it over all rows, and the rows
+    // above and below it within its columns. For every metric policy the closest point of an
+    // axis-aligned box is the query clamped into it, and keys are monotone in |dx| and |dy| even
+    // after float rounding, so a block's key is a safe lower bound for every site in it. For
+    // weighted metrics the block key uses the largest weight in the grid, which keeps it a lower
+    // bound and lets the search stop about that far beyond where an unweighted one would rather
+    // than scanning every site. Each step scans the strip next to the block with the smallest
+    // bound, which keeps the rectangle narrow when the query sits far outside the sites, and the
+    // search stops once no block can beat the best key. Ties go to the lowest index to match
+    // nearestSiteScalar.
+    template<class M>
+    int nearest(float px, float py, const M &metric = M()) const {
+        if (sites.empty()) return -1;
+
+        int cx = cellX(px);
+        int cy = cellY(py);
+        float minKey = M::keyOf(NO_SITE_DIST);
+        int best = -1;
+        scanCell(cellIndex(cx, cy), px, py, minKey, best, metric);
+        searchFrom(px, py, cx, cy, cx, cy, minKey, best, metric);
+        return best;
+    }
+
+    // nearest() that also reports the winner's key and the runner-up's, the best key among the
+    // other sites (keyOf(NO_SITE_DIST) when there is none). The search runs until no block can
+    // beat the runner-up, so both keys are exact.
+    template<class M>
+    int nearestTwo(float px, float py, float &bestKey, float &secondKey, const M &metric = M()) const {
+        bestKey = secondKey = M::keyOf(NO_SITE_DIST);
+        if (sites.empty()) return -1;
+
+        int best = -1;
+        auto scan = [&](int c) {
+            for (int k = cellStart[c]; k < cellEnd[c]; ++k) {
+                float key = siteKey(xs[k] - px, ys[k] - py, ws[k], metric);
+                int i = sites[k];
+                if (key < bestKey || (key == bestKey && best != -1 && i < best)) {
+                    secondKey = bestKey;
+                    bestKey = key;
+                    best = i;
+                } else if (key < secondKey) {
+                    secondKey = key;
+                }
+            }
+        };
+        int x0 = cellX(px), y0 = cellY(py);
+        int x1 = x0, y1 = y0;
+        scan(cellIndex(x0, y0));
+        for (;;) {
+            int side;
+            float bound = blockBounds(px, py, x0, y0, x1, y1, side, metric);
+            if (side < 0 || bound > secondKey) break;
+            growRect(x0, y0, x1, y1, side, scan);
+        }
+        return best;
+    }
+
+    // Continues a search whose rectangle [x0, x1] x [y0, y1] has already been scanned.
+    template<class M>
+    void searchFrom(float px, float py, int x0, int y0, int x1, int y1, float &minKey, int &best,
+                    const M &metric = M()) const {
+        auto scan = [&](int c) {
+            scanCell(c, px, py, minKey, best, metric);
+        };
+        for (;;) {
+            int side;
+            float bound = blockBounds(px, py, x0, y0, x1, y1, side, metric);
+            if (side < 0 || bound > minKey) break;
+            growRect(x0, y0, x1, y1, side, scan);
+        }
+    }
+
+    template<class M>
+    void scanCell(int c, float px, float py, float &minKey, int &best, const M &metric = M()) const {
+        for (int k = cellStart[c]; k < cellEnd[c]; ++k) {
+            float key = siteKey(xs[k] - px, ys[k] - py, ws[k], metric);
+            int i = sites[k];
+            if (key < minKey || (key == minKey && best != -1 && i < best)) {
+                minKey = key;
+                best = i;
+            }
+        }
+    }
+
+    // Block search for several metrics at once. While every metric can still improve, each strip
+    // is scanned a single time for all of them and the rectangle grows toward the closest block of
+    // any metric. Once one metric is settled the others would mostly pull the rectangle in
+    // different directions, so each finishes on its own from the shared rectangle. Each result is
+    // the same as a separate nearest<M>() call.
+    template<class... Ms>
+    void nearestEach(float px, float py, int *best) const {
+        constexpr size_t count = sizeof...(Ms);
+        float minKey[count] = {Ms::keyOf(NO_SITE_DIST)...};
+        for (size_t m = 0; m < count; ++m) best[m] = -1;
+        if (sites.empty()) return;
+
+        int cx = cellX(px);
+        int cy = cellY(py);
+
+        auto scanJoint = [&](int c) {
+            for (int k = cellStart[c]; k < cellEnd[c]; ++k) {
+                float dx = xs[k] - px;
+                float dy = ys[k] - py;
+                int i = sites[k];
+                size_t m = 0;
+                auto consider = [&](float key) {
+                    if (key < minKey[m] || (key == minKey[m] && best[m] != -1 && i < best[m])) {
+                        minKey[m] = key;
+                        best[m] = i;
+                    }
+                    ++m;
+                };
+                (consider(siteKey<Ms>(dx, dy, ws[k])), ...);
+            }
+        };
+
+        int x0 = cx, x1 = cx, y0 = cy, y1 = cy;
+        scanJoint(cellIndex(cx, cy));
+        for (;;) {
+            int side = -1;
+            float closest = 0;
+            bool settled = false;
+            size_t m = 0;
+            auto pick = [&](auto metric) {
+                using M = decltype(metric);
+                int s;
+                float bound = blockBounds(px, py, x0, y0, x1, y1, s, metric);
+                if (s < 0 || bound > minKey[m]) {
+                    settled = true;
+                } else if (side < 0 || M::distance(bound) < closest) {
+                    side = s;
+                    closest = M::distance(bound);
+                }
+                ++m;
+            };
+            (pick(Ms{}), ...);
+            if (settled || (x1 - x0) + (y1 - y0) >= JOINT_SEARCH_SPAN) break;
+            growRect(x0, y0, x1, y1, side, scanJoint);
+        }
+
+        size_t m = 0;
+        auto finish = [&](auto metric) {
+            searchFrom(px, py, x0, y0, x1, y1, minKey[m], best[m], metric);
+            ++m;
+        };
+        (finish(Ms{}), ...);
+    }
+
+    // Smallest key among the four blocks around the searched rectangle; side is set to the block
+    // it came from (0 left, 1 right, 2 above, 3 below), or -1 when the grid is exhausted.
+    template<class M>
+    float blockBounds(float px, float py, int x0, int y0, int x1, int y1, int &side, const M &metric = M()) const {
+        float bound = M::keyOf(NO_SITE_DIST);
+        side = -1;
+        auto consider = [&](int s, int bx0, int by0, int bx1, int by1) {
+            float key = boxKey(px, py, bx0, by0, bx1, by1, metric);
+            if (side < 0 || key < bound) {
+                bound = key;
+                side = s;
+            }
+        };
+        if (x0 > 0) consider(0, 0, 0, x0 - 1, rows - 1);
+        if (x1 < cols - 1) consider(1, x1 + 1, 0, cols - 1, rows - 1);
+        if (y0 > 0) consider(2, x0, 0, x1, y0 - 1);
+        if (y1 < rows - 1) consider(3, x0, y1 + 1, x1, rows - 1);
+        return bound;
+    }
+
+    // Extends the rectangle by one strip on the given side and scans the new cells.
+    template<class ScanCell>
+    void growRect(int &x0, int &y0, int &x1, int &y1, int side, ScanCell &scanCell) const {
+        switch (side) {
+            case 0:
+                --x0;
+                for (int y = y0; y <= y1; ++y) scanCell(cellIndex(x0, y));
+                break;
+            case 1:
+                ++x1;
+                for (int y = y0; y <= y1; ++y) scanCell(cellIndex(x1, y));
+                break;
+            case 2:
+                --y0;
+                for (int x = x0; x <= x1; ++x) scanCell(cellIndex(x, y0));
+                break;
+            default:
+                ++y1;
+                for (int x = x0; x <= x1; ++x) scanCell(cellIndex(x, y1));
+                break;
+        }
+    }
+
+    // Key of the cell block [cx0, cx1] x [cy0, cy1], padded slightly so sites that floor()
+    // placed in a cell by rounding still lie inside it, and taken with the largest weight.
+    template<class M>
+    float boxKey(float px, float py, int cx0, int cy0, int cx1, int cy1, const M &metric = M()) const {
+        double pad = cellSize * 1e-6;
+        float bx = std::clamp(px, static_cast<float>(minX + cx0 * cellSize - pad),
+                              static_cast<float>(minX + (cx1 + 1) * cellSize + pad));
+        float by = std::clamp(py, static_cast<float>(minY + cy0 * cellSize - pad),
+                              static_cast<float>(minY + (cy1 + 1) * cellSize + pad));
+        return siteKey(bx - px, by - py, maxWeight, metric);
+    }
+};
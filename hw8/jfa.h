@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include "metrics.h"
+#include "tiles.h"
+
+// Jump Flooding: seed every site into a label buffer, then let each pixel adopt the best
+// label seen at +-step in each direction while step halves down to 1. Approximate, but
+// O(width * height * log2(max(width, height))) regardless of the site count. Power cells need
+// not contain their site, so the seeds of weighted sites can start outside their cell.
+template<class M>
+std::vector<int> jumpFlood(const std::vector<Point> &points, int width, int height, int threads,
+                           const M &metric = M()) {
+    std::vector<int> labels(static_cast<size_t>(width) * height, -1);
+    std::vector<float> keys(labels.size(), 0);
+    std::vector<float> xs, ys, ws;
+    for (const auto &p: points) {
+        xs.push_back(static_cast<float>(p.x));
+        ys.push_back(static_cast<float>(p.y));
+        ws.push_back(static_cast<float>(p.weight));
+    }
+
+    for (int i = 0; i < static_cast<int>(points.size()); ++i) {
+        int x = std::clamp(static_cast<int>(std::lround(points[i].x)), 0, width - 1);
+        int y = std::clamp(static_cast<int>(std::lround(points[i].y)), 0, height - 1);
+        size_t idx = static_cast<size_t>(y) * width + x;
+        float key = siteKey(xs[i] - x, ys[i] - y, ws[i], metric);
+        if (labels[idx] == -1 || key < keys[idx]) {
+            labels[idx] = i;
+            keys[idx] = key;
+        }
+    }
+
+    int step = 1;
+    while (step * 2 < std::max(width, height)) step *= 2;
+
+    std::vector<int> next(labels.size());
+    std::vector<float> nextKeys(labels.size());
+    for (; step >= 1; step /= 2) {
+        forEachTile(width, height, threads, [&](const Tile &tile) {
+            for (int y = tile.y0; y < tile.y1; ++y) {
+                for (int x = tile.x0; x < tile.x1; ++x) {
+                    size_t idx = static_cast<size_t>(y) * width + x;
+                    int best = labels[idx];
+                    float minKey = keys[idx];
+
+                    for (int dy = -step; dy <= step; dy += step) {
+                        int ny = y + dy;
+                        if (ny < 0 || ny >= height) continue;
+                        for (int dx = -step; dx <= step; dx += step) {
+                            int nx = x + dx;
+                            if (nx < 0 || nx >= width) continue;
+                            int candidate = labels[static_cast<size_t>(ny) * width + nx];
+                            if (candidate == -1 || candidate == best) continue;
+                            float key = siteKey(xs[candidate] - x, ys[candidate] - y, ws[candidate], metric);
+                            if (best == -1 || key < minKey || (key == minKey && candidate < best)) {
+                                best = candidate;
+                                minKey = key;
+                            }
+                        }
+                    }
+
+                    next[idx] = best;
+                    nextKeys[idx] = minKey;
+                }
+            }
+        });
+        labels.swap(next);
+        keys.swap(nextKeys);
+    }
+
+    return labels;
+}
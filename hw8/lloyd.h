@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "grid.h"
+#include "render.h"
+#include "tiles.h"
+
+// Running sums of the pixels one cell owns; the centroid is (sumX, sumY) / count.
+struct CellSums {
+    double sumX = 0, sumY = 0;
+    double count = 0;
+};
+
+struct RelaxResult {
+    int iterations = 0;
+    double maxShift = 0;
+};
+
+// Lloyd relaxation towards a centroidal Voronoi set under metric M. Each iteration rasterizes
+// the cells at the render resolution through options.view, summing pixel positions per cell
+// into one accumulator array per worker (no locks, no label buffer), then moves every site to
+// the centroid of its pixels. Sites that own no pixel stay put. Stops after maxIterations or
+// once no site moved more than tolerance pixels. The cells always come from the exact grid
+// search, since relaxing approximate cells would drift, so options.mode is ignored.
+template<class M>
+RelaxResult relaxPoints(std::vector<Point> &points, const RenderOptions &options, int maxIterations,
+                        double tolerance) {
+    RelaxResult result;
+    int width = options.width;
+    int height = options.height;
+    int workers = std::max(1, options.threads);
+    const View &view = options.view;
+    const M metric = metricFor<M>(options);
+    std::vector<std::vector<CellSums>> sums(workers);
+    PROFILE_STAGE("relax");
+
+    while (result.iterations < maxIterations && !points.empty()) {
+        std::vector<Point> pixels = toPixelSpace(points, view);
+        SiteGrid grid;
+        grid.build(pixels);
+        for (auto &worker: sums) {
+            worker.assign(points.size(), CellSums());
+        }
+
+        // Runs of equal labels along a row are added in one step: count, sum of x over the run
+        // (an arithmetic series) and y times the count.
+        forEachTileOnWorkers(width, height, workers, [&](const Tile &tile, int worker) {
+            std::vector<CellSums> &cells = sums[worker];
+            for (int y = tile.y0; y < tile.y1; ++y) {
+                int runStart = tile.x0;
+                int runLabel = grid.nearest(static_cast<float>(tile.x0), static_cast<float>(y), metric);
+                for (int x = tile.x0 + 1; x <= tile.x1; ++x) {
+                    int label = x < tile.x1 ? grid.nearest(static_cast<float>(x), static_cast<float>(y), metric) : -2;
+                    if (label == runLabel) continue;
+                    if (runLabel >= 0) {
+                        double length = x - runStart;
+                        CellSums &cell = cells[runLabel];
+                        cell.count += length;
+                        cell.sumX += length * (runStart + x - 1) / 2.0;
+                        cell.sumY += length * y;
+                    }
+                    runStart = x;
+                    runLabel = label;
+                }
+            }
+        });
+
+        double maxShift = 0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            CellSums total;
+            for (const auto &worker: sums) {
+                total.count += worker[i].count;
+                total.sumX += worker[i].sumX;
+                total.sumY += worker[i].sumY;
+            }
+            if (total.count == 0) continue;
+            double cx = total.sumX / total.count;
+            double cy = total.sumY / total.count;
+            maxShift = std::max(maxShift, std::hypot(cx - pixels[i].x, cy - pixels[i].y));
+            points[i].x = view.originX + cx * view.scale;
+            points[i].y = view.originY + cy * view.scale;
+        }
+
+        ++result.iterations;
+        result.maxShift = maxShift;
+        std::cout << "Lloyd iteration " << result.iterations << ": max shift " << maxShift << " px\n";
+        if (maxShift < tolerance) break;
+    }
+    return result;
+}
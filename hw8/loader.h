@@ -0,0 +1,168 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "point.h"
+
+using json = nlohmann::json;
+
+// Builds the whole document first; kept as the reference the streaming loader is checked against.
+std::vector<Point> parseSpotsDom(std::istream &in) {
+    json j;
+    in >> j;
+
+    std::vector<Point> points;
+    for (const auto &spot: j["spots"]) {
+        Point p;
+        p.x = spot["x"];
+        p.y = spot["y"];
+        p.weight = spot.value("weight", 0.0);
+        p.color = {0, 0, 0, 255};
+        points.push_back(p);
+    }
+    return points;
+}
+
+// SAX handler that only tracks where it is in {"spots": [{"x": .., "y": .., "weight": ..}, ...]}
+// and appends each finished spot, so memory beyond the point buffer stays constant whatever the
+// file size. The weight is optional and defaults to 0.
+struct SpotsSax : nlohmann::json_sax<json> {
+    std::vector<Point> &points;
+    std::istream &in;
+    std::streamoff totalBytes;
+    int depth = 0;
+    bool spotsKey = false;
+    bool inSpots = false;
+    std::string field;
+    Point spot{};
+    bool hasX = false, hasY = false;
+    size_t skipped = 0;
+    int reportedPercent = 0;
+    std::string error;
+
+    SpotsSax(std::vector<Point> &points, std::istream &in, std::streamoff totalBytes)
+            : points(points), in(in), totalBytes(totalBytes) {}
+
+    bool number(double value) {
+        if (inSpots && depth == 3) {
+            if (field == "x") {
+                spot.x = value;
+                hasX = true;
+            } else if (field == "y") {
+                spot.y = value;
+                hasY = true;
+            } else if (field == "weight") {
+                spot.weight = value;
+            }
+        }
+        return true;
+    }
+
+    bool null() override {
+        return true;
+    }
+
+    bool boolean(bool) override {
+        return true;
+    }
+
+    bool number_integer(number_integer_t val) override {
+        return number(static_cast<double>(val));
+    }
+
+    bool number_unsigned(number_unsigned_t val) override {
+        return number(static_cast<double>(val));
+    }
+
+    bool number_float(number_float_t val, const string_t &) override {
+        return number(val);
+    }
+
+    bool string(string_t &) override {
+        return true;
+    }
+
+    bool binary(binary_t &) override {
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        ++depth;
+        if (inSpots && depth == 3) {
+            spot = {};
+            hasX = hasY = false;
+        }
+        return true;
+    }
+
+    bool key(string_t &val) override {
+        if (depth == 1) {
+            spotsKey = (val == "spots");
+        } else if (inSpots && depth == 3) {
+            field = val;
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        if (inSpots && depth == 3) {
+            if (hasX && hasY) {
+                spot.color = {0, 0, 0, 255};
+                points.push_back(spot);
+                if ((points.size() & 0xFFFF) == 0) reportProgress();
+            } else {
+                ++skipped;
+            }
+        }
+        --depth;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        ++depth;
+        if (depth == 2 && spotsKey) inSpots = true;
+        return true;
+    }
+
+    bool end_array() override {
+        if (depth == 2) inSpots = spotsKey = false;
+        --depth;
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string &, const nlohmann::detail::exception &ex) override {
+        error = "byte " + std::to_string(position) + ": " + ex.what();
+        return false;
+    }
+
+    void reportProgress() {
+        if (totalBytes <= 0) return;
+        std::streamoff at = in.tellg();
+        int percent = static_cast<int>(100 * at / totalBytes);
+        if (at >= 0 && percent >= reportedPercent + 10) {
+            reportedPercent = percent / 10 * 10;
+            std::cout << "Parsed " << points.size() << " spots (" << reportedPercent << "%)...\n";
+        }
+    }
+};
+
+// Streams the "spots" array straight into the point buffer. Returns false with a message on
+// malformed JSON; spots missing x or y are skipped and counted.
+bool streamSpots(std::istream &in, std::vector<Point> &points, std::string &error) {
+    in.seekg(0, std::ios::end);
+    std::streamoff totalBytes = in.tellg();
+    in.seekg(0, std::ios::beg);
+
+    SpotsSax sax(points, in, totalBytes);
+    bool ok = json::sax_parse(in, &sax);
+    if (!ok) {
+        error = sax.error.empty() ? "unexpected end of input" : sax.error;
+        return false;
+    }
+    if (sax.skipped > 0) {
+        std::cout << "Skipped " << sax.skipped << " spots without x/y\n";
+    }
+    return true;
+}
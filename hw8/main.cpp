@@ -1,15 +1,32 @@
 #include <SDL.h>
 #include <SDL_image.h>
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <ctime>
 #include <windows.h>
-#include "json.hpp"
-
-using json = nlohmann::json;
+#include "animate.h"
+#include "antialias.h"
+#include "delaunay.h"
+#include "draw.h"
+#include "fieldfile.h"
+#include "lloyd.h"
+#include "loader.h"
+#include "pointfile.h"
+#include "render.h"
+#include "render_state.h"
+#include "png.h"
+#include "rowwriter.h"
 
 WORD WHITE = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
 WORD CYAN = FOREGROUND_GREEN | FOREGROUND_BLUE;
@@ -19,123 +36,503 @@ WORD RED = FOREGROUND_RED | FOREGROUND_INTENSITY;
 WORD GREEN = FOREGROUND_GREEN | FOREGROUND_INTENSITY;
 WORD GRAY = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
 
-const int WIDTH = 1000;
-const int HEIGHT = 1000;
-const int SPOT_RADIUS = 5;
+SDL_Color randomColor() {
+    return {
+            static_cast<Uint8>(rand() % 256),
+            static_cast<Uint8>(rand() % 256),
+            static_cast<Uint8>(rand() % 256),
+            255
+    };
+}
 
-struct Point {
-    double x, y;
-    SDL_Color color;
-};
+// Profiled as "load", with "load/read" for binary files, "load/parse" for JSON, which is read
+// as it is parsed, and "load/map" for the colors.
+std::vector<Point> loadPoints(const std::string &filename) {
+    PROFILE_STAGE("load");
+    std::vector<Point> points;
+    std::string error;
+    if (isPointFile(filename)) {
+        std::cout << "Mapping binary spots...\n";
+        bool hasColors = false;
+        PROFILE_STAGE("load/read");
+        if (!readPointFile(filename, points, hasColors, error)) {
+            std::cerr << "Failed to read " << filename << ": " << error << std::endl;
+            return {};
+        }
+        if (hasColors) return points;
+    } else {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << filename << std::endl;
+            return {};
+        }
+
+        std::cout << "Streaming spots...\n";
+        PROFILE_STAGE("load/parse");
+        if (!streamSpots(file, points, error)) {
+            std::cerr << "Failed to parse " << filename << ": " << error << std::endl;
+            return {};
+        }
+    }
+
+    std::cout << "Mapping points...\n";
+    PROFILE_STAGE("load/map");
+    for (auto &p: points) {
+        p.color = randomColor();
+    }
+
+    return points;
+}
 
 std::vector<Point> loadPoints() {
     std::string filename;
-    std::cout << "Enter the name of the JSON source file:\n";
+    std::cout << "Enter the name of the JSON or binary source file:\n";
     std::cin >> filename;
+    return loadPoints(filename);
+}
 
-    std::ifstream file(filename);
+// Converts a {"spots": [...]} JSON file into the binary point format. Colors are not stored,
+// since the JSON source has none and the loader assigns random ones anyway.
+int convertPoints(const std::string &source, const std::string &target) {
+    std::ifstream file(source);
     if (!file.is_open()) {
-        std::cerr << "Failed to open " << filename << std::endl;
-        return {};
+        std::cerr << "Failed to open " << source << std::endl;
+        return 1;
+    }
+    std::vector<Point> points;
+    std::string error;
+    if (!streamSpots(file, points, error)) {
+        std::cerr << "Failed to parse " << source << ": " << error << std::endl;
+        return 1;
     }
+    if (!writePointFile(target, points, false)) {
+        std::cerr << "Failed to write " << target << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << points.size() << " spots to " << target << std::endl;
+    return 0;
+}
 
-    srand(time(nullptr));
+// Delaunay neighbours as text, one line per site: "<site>: <neighbour> <neighbour> ...".
+bool writeAdjacency(const std::string &path, const std::vector<Point> &points) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    SiteAdjacency adjacency = Delaunay(points).adjacency();
+    double ms = 1000.0 * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    std::cout << "Triangulated " << points.size() << " spots in " << ms << " ms\n";
 
-    std::cout << "Reading file content...\n";
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+    for (size_t i = 0; i + 1 < adjacency.offsets.size(); ++i) {
+        out << i << ":";
+        for (int k = adjacency.offsets[i]; k < adjacency.offsets[i + 1]; ++k) {
+            out << " " << adjacency.neighbors[k];
+        }
+        out << "\n";
+    }
+    return out.good();
+}
 
-    json j;
-    file >> j;
+// Output surface kept between renders; only reallocated when the resolution changes.
+class Canvas {
+public:
+    Canvas() = default;
+    Canvas(const Canvas &) = delete;
+    Canvas &operator=(const Canvas &) = delete;
 
-    std::vector<Point> points;
-    std::cout << "Mapping points...\n";
-    for (const auto &spot: j["spots"]) {
-        Point p;
-        p.x = spot["x"];
-        p.y = spot["y"];
-        p.color = {
-                static_cast<Uint8>(rand() % 256),
-                static_cast<Uint8>(rand() % 256),
-                static_cast<Uint8>(rand() % 256),
-                255
-        };
-        points.push_back(p);
+    ~Canvas() {
+        if (surface) SDL_FreeSurface(surface);
     }
 
-    return points;
+    SDL_Surface *get(int width, int height) {
+        if (surface && surface->w == width && surface->h == height) return surface;
+        if (surface) SDL_FreeSurface(surface);
+        std::cout << "Creating surface...\n";
+        PROFILE_STAGE("surface");
+        surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+        return surface;
+    }
+
+private:
+    SDL_Surface *surface = nullptr;
+};
+
+// Paints one label buffer into the surface, overlays the anti-aliased border pixels, stamps the
+// spots if asked and saves it.
+bool saveLabels(SDL_Surface *surface, const std::vector<int> &labels, const std::vector<Uint32> &siteColors,
+                const std::vector<Point> &points, bool showSpots, const std::string &filename, int threads,
+                const std::vector<BlendedPixel> &blended = {}) {
+    paintLabels(surface, labels, siteColors);
+    Uint32 *pixels = static_cast<Uint32 *>(surface->pixels);
+    for (const auto &pixel: blended) {
+        const SDL_Color &c = pixel.color;
+        pixels[pixel.index] = SDL_MapRGBA(surface->format, c.r, c.g, c.b, c.a);
+    }
+
+    if (showSpots) {
+        std::cout << "Putting spots...\n";
+        PROFILE_STAGE("spots");
+        SDL_Color spotColor = {0, 0, 0, 255};
+        for (const auto &p: points) {
+            drawSpot(surface, static_cast<int>(p.x), static_cast<int>(p.y), spotColor);
+        }
+    }
+
+    if (!savePng(surface, filename, threads)) {
+        std::cerr << "Failed to save " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Color of every value a label of type L can hold: the site colors in order, then opaque black
+// for the rest, which covers the "no site" value. For Uint8 labels this is the PNG palette.
+template<class L>
+std::vector<SDL_Color> labelColors(const std::vector<Point> &points) {
+    std::vector<SDL_Color> colors(static_cast<size_t>(std::numeric_limits<L>::max()) + 1, SDL_Color{0, 0, 0, 255});
+    for (size_t i = 0; i < points.size(); ++i) {
+        colors[i] = points[i].color;
+    }
+    return colors;
 }
 
-float euclideanDist(double x1, double y1, double x2, double y2) {
-    return std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+// PNG writer matching the label type: indexed color for Uint8 labels, RGBA otherwise.
+template<class L>
+PngWriter labelWriter(const std::vector<SDL_Color> &colors, int threads) {
+    if constexpr (sizeof(L) == 1) {
+        return PngWriter(threads, colors);
+    } else {
+        return PngWriter(threads);
+    }
 }
 
-float manhattanDist(double x1, double y1, double x2, double y2) {
-    return std::abs(x2 - x1) + std::abs(y2 - y1);
+// Stamps the spots falling into rows [firstRow, firstRow + rows) of the image as "no site",
+// which is black like the spots of the RGBA path, and hands the rows to the writer. Uint8 labels
+// are already palette indices; wider ones are expanded to RGBA a row at a time, so the image
+// never exists at 32 bits per pixel.
+template<class L>
+bool writeLabelRows(PngWriter &writer, std::vector<L> &labels, int width, int firstRow, int rows,
+                    const std::vector<SDL_Color> &colors, const std::vector<Point> &spots) {
+    if (!spots.empty()) {
+        PROFILE_STAGE("spots");
+        for (const auto &p: spots) {
+            if (p.y + SPOT_RADIUS >= firstRow && p.y - SPOT_RADIUS < firstRow + rows) {
+                forSpotPixels(width, rows, static_cast<int>(p.x), static_cast<int>(p.y) - firstRow,
+                              [&](size_t i) { labels[i] = static_cast<L>(-1); });
+            }
+        }
+    }
+
+    PROFILE_STAGE("png");
+    std::vector<Uint8> row(sizeof(L) == 1 ? 0 : static_cast<size_t>(width) * 4);
+    for (int y = 0; y < rows; ++y) {
+        const L *src = &labels[static_cast<size_t>(y) * width];
+        if constexpr (sizeof(L) == 1) {
+            if (!writer.writeRow(src)) return false;
+        } else {
+            for (int x = 0; x < width; ++x) {
+                std::memcpy(&row[4 * static_cast<size_t>(x)], &colors[src[x]], 4);
+            }
+            if (!writer.writeRow(row.data())) return false;
+        }
+    }
+    return true;
 }
 
-float chebyshevDist(double x1, double y1, double x2, double y2) {
-    return std::max(std::abs(x2 - x1), std::abs(y2 - y1));
+template<class L>
+bool saveNarrowLabels(std::vector<L> &labels, const std::vector<SDL_Color> &colors, const std::vector<Point> &points,
+                      bool showSpots, const std::string &filename, const RenderOptions &options) {
+    PngWriter writer = labelWriter<L>(colors, options.threads);
+    bool ok = writer.open(filename, options.width, options.height) &&
+              writeLabelRows(writer, labels, options.width, 0, options.height, colors,
+                             showSpots ? points : std::vector<Point>());
+    PROFILE_STAGE("png");
+    if (!writer.close() || !ok) {
+        std::cerr << "Failed to save " << filename << std::endl;
+        return false;
+    }
+    return true;
 }
 
-void drawSpot(SDL_Surface *surface, int centerX, int centerY, SDL_Color color) {
-    Uint32 pixelColor = SDL_MapRGBA(surface->format, color.r, color.g, color.b, color.a);
-    Uint32 *pixels = static_cast<Uint32 *>(surface->pixels);
+// Optional raw outputs of a render, written next to the image; empty paths are skipped.
+struct FieldOutputs {
+    std::string labels;
+    std::string distances;
+};
 
-    for (int y = -SPOT_RADIUS; y <= SPOT_RADIUS; ++y) {
-        for (int x = -SPOT_RADIUS; x <= SPOT_RADIUS; ++x) {
-            if (x * x + y * y <= SPOT_RADIUS * SPOT_RADIUS) {
-                int drawX = centerX + x;
-                int drawY = centerY + y;
+// Writes the label and distance fields of a render as its labels come in, all at once or band
+// by band. Each distance is recomputed from the pixel's label, which is one metric evaluation
+// per pixel rather than a second nearest-site search.
+template<class M>
+class FieldSink {
+public:
+    explicit FieldSink(const M &metric) : metric(metric) {}
 
-                if (drawX >= 0 && drawX < WIDTH && drawY >= 0 && drawY < HEIGHT) {
-                    pixels[drawY * WIDTH + drawX] = pixelColor;
+    bool open(const FieldOutputs &outputs, const std::vector<Point> &points, const RenderOptions &options) {
+        const View &view = options.view;
+        if (!outputs.labels.empty() &&
+            !labelFile.open(outputs.labels, FIELD_LABELS, options.width, options.height,
+                            view.originX, view.originY, view.scale)) {
+            std::cerr << "Failed to start " << outputs.labels << std::endl;
+            return false;
+        }
+        if (!outputs.distances.empty() &&
+            !distanceFile.open(outputs.distances, FIELD_DISTANCES, options.width, options.height,
+                               view.originX, view.originY, view.scale)) {
+            std::cerr << "Failed to start " << outputs.distances << std::endl;
+            return false;
+        }
+        if (distanceFile.isOpen()) sites = toPixelSpace(points, view);
+        width = options.width;
+        scale = static_cast<float>(view.scale);
+        return true;
+    }
+
+    // Rows [firstRow, firstRow + rows) of the image; call before spots are stamped into labels.
+    template<class L>
+    bool write(const std::vector<L> &labels, int firstRow, int rows) {
+        if (!labelFile.isOpen() && !distanceFile.isOpen()) return true;
+        PROFILE_STAGE("fields");
+        labelRow.resize(width);
+        distanceRow.resize(width);
+        for (int y = 0; y < rows; ++y) {
+            float py = static_cast<float>(firstRow + y);
+            for (int x = 0; x < width; ++x) {
+                L label = labels[static_cast<size_t>(y) * width + x];
+                if (label == static_cast<L>(-1)) {
+                    labelRow[x] = UINT32_MAX;
+                    distanceRow[x] = std::numeric_limits<float>::infinity();
+                    continue;
+                }
+                labelRow[x] = static_cast<uint32_t>(label);
+                if (distanceFile.isOpen()) {
+                    const Point &site = sites[label];
+                    float key = siteKey(static_cast<float>(site.x) - x, static_cast<float>(site.y) - py,
+                                        static_cast<float>(site.weight), metric);
+                    distanceRow[x] = M::distance(key) * scale;
                 }
             }
+            if (labelFile.isOpen() && !labelFile.write(labelRow.data(), labelRow.size())) return false;
+            if (distanceFile.isOpen() && !distanceFile.write(distanceRow.data(), distanceRow.size())) return false;
         }
+        return true;
+    }
+
+    bool close() {
+        bool ok = true;
+        if (labelFile.isOpen()) ok = labelFile.close() && ok;
+        if (distanceFile.isOpen()) ok = distanceFile.close() && ok;
+        return ok;
     }
+
+private:
+    M metric;
+    FieldWriter labelFile, distanceFile;
+    std::vector<Point> sites;
+    std::vector<uint32_t> labelRow;
+    std::vector<float> distanceRow;
+    int width = 0;
+    float scale = 1;
+};
+
+// Border pixels of the labels supersampled as options.antialias asks, or none when it is off.
+template<class M>
+std::vector<BlendedPixel> smoothBorders(const std::vector<Point> &pixels, const std::vector<int> &labels,
+                                        const RenderOptions &options) {
+    if (options.antialias == 0) return {};
+    std::vector<BlendedPixel> blended = antialiasBorders<M>(pixels, labels, options);
+    std::cout << "Anti-aliased " << blended.size() << " border pixels ("
+              << 100.0 * blended.size() / std::max<size_t>(1, labels.size()) << "%)...\n";
+    return blended;
 }
 
-void generateVoronoiImage(const std::vector<Point> &points,
+template<class M, class L>
+bool writeFields(const FieldOutputs &outputs, const std::vector<L> &labels, const std::vector<Point> &points,
+                 const RenderOptions &options) {
+    if (outputs.labels.empty() && outputs.distances.empty()) return true;
+    FieldSink<M> sink(metricFor<M>(options));
+    bool ok = sink.open(outputs, points, options) && sink.write(labels, 0, options.height);
+    if (!sink.close() || !ok) {
+        std::cerr << "Failed to write the label or distance field" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Up to 65,534 sites the labels are rendered narrow and written without touching the surface,
+// unless the borders are anti-aliased, which needs colors beyond the palette. The label and
+// distance fields, when asked for, come from the same labels.
+template<class M>
+bool generateVoronoiImage(const std::vector<Point> &points,
                           const std::string &filename,
-                          float (*distanceFunc)(double, double, double, double),
                           bool showSpots,
-                          const std::string &quote) {
-    std::cout << "Creating surface...\n";
-    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 32, SDL_PIXELFORMAT_RGBA32);
+                          const std::string &quote,
+                          const RenderOptions &options,
+                          Canvas &canvas,
+                          const FieldOutputs &fields = {}) {
+    std::cout << quote;
+    std::vector<Point> pixels = toPixelSpace(points, options.view);
+    bool narrow = options.antialias == 0;
+    if (narrow && labelTypeFits<Uint8>(points.size())) {
+        std::vector<Uint8> labels = computeLabels<M, Uint8>(pixels, options);
+        return writeFields<M>(fields, labels, points, options) &&
+               saveNarrowLabels(labels, labelColors<Uint8>(points), pixels, showSpots, filename, options);
+    }
+    if (narrow && labelTypeFits<Uint16>(points.size())) {
+        std::vector<Uint16> labels = computeLabels<M, Uint16>(pixels, options);
+        return writeFields<M>(fields, labels, points, options) &&
+               saveNarrowLabels(labels, labelColors<Uint16>(points), pixels, showSpots, filename, options);
+    }
 
-    Uint32 *pixels = static_cast<Uint32 *>(surface->pixels);
+    SDL_Surface *surface = canvas.get(options.width, options.height);
+    if (!surface) {
+        std::cerr << "Failed to create surface: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    std::vector<int> labels = computeLabels<M>(pixels, options);
+    std::vector<BlendedPixel> blended = smoothBorders<M>(pixels, labels, options);
+    return writeFields<M>(fields, labels, points, options) &&
+           saveLabels(surface, labels, mapSiteColors(surface, points), pixels, showSpots, filename, options.threads,
+                      blended);
+}
 
-    std::cout << quote;
-    for (int y = 0; y < HEIGHT; ++y) {
-        for (int x = 0; x < WIDTH; ++x) {
-            double px = static_cast<double>(x);
-            double py = static_cast<double>(y);
-            float minDist = 1e9;
-            SDL_Color bestColor = {0, 0, 0, 255};
-
-            for (const auto &p: points) {
-                float dist = distanceFunc(px, py, p.x, p.y);
-                if (dist < minDist) {
-                    minDist = dist;
-                    bestColor = p.color;
+// Banded render into narrow labels: each band is stamped and streamed straight from its label
+// buffer, without a surface.
+template<class M, class L>
+bool generateBandedLabelImage(const std::vector<Point> &points,
+                              const std::string &filename,
+                              bool showSpots,
+                              const RenderOptions &options,
+                              int bandRows,
+                              const FieldOutputs &fields) {
+    std::vector<SDL_Color> colors = labelColors<L>(points);
+    PngWriter writer = labelWriter<L>(colors, options.threads);
+    FieldSink<M> fieldSink(metricFor<M>(options));
+    if (!writer.open(filename, options.width, options.height) || !fieldSink.open(fields, points, options)) {
+        std::cerr << "Failed to start " << filename << std::endl;
+        return false;
+    }
+    std::vector<Point> spots = showSpots ? toPixelSpace(points, options.view) : std::vector<Point>();
+
+    bool ok = renderBands<M, L>(points, options, bandRows, [&](std::vector<L> &labels, int y0, int rows) {
+        return fieldSink.write(labels, y0, rows) &&
+               writeLabelRows(writer, labels, options.width, y0, rows, colors, spots);
+    });
+    ok = fieldSink.close() && ok;
+    PROFILE_STAGE("png");
+    if (!writer.close() || !ok) {
+        std::cerr << "Failed to write " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Out-of-core variant for images too large to hold: bands of bandRows rows are rendered into a
+// band-sized surface, get their spots, and are handed to a streaming writer before the next band,
+// so PNG compression of one band overlaps with rendering the next. A ".ppm" name writes PPM;
+// PNGs of up to 65,534 sites take the narrow-label path above.
+template<class M>
+bool generateBandedImage(const std::vector<Point> &points,
+                         const std::string &filename,
+                         bool showSpots,
+                         const RenderOptions &options,
+                         int bandRows,
+                         Canvas &canvas,
+                         const FieldOutputs &fields = {}) {
+    bandRows = std::max(1, std::min(bandRows, options.height));
+    bool ppm = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".ppm") == 0;
+    if (!ppm && labelTypeFits<Uint8>(points.size())) {
+        return generateBandedLabelImage<M, Uint8>(points, filename, showSpots, options, bandRows, fields);
+    }
+    if (!ppm && labelTypeFits<Uint16>(points.size())) {
+        return generateBandedLabelImage<M, Uint16>(points, filename, showSpots, options, bandRows, fields);
+    }
+
+    SDL_Surface *surface = canvas.get(options.width, bandRows);
+    std::unique_ptr<RowWriter> writer;
+    if (ppm) {
+        writer = std::make_unique<PpmWriter>();
+    } else {
+        writer = std::make_unique<PngWriter>(options.threads);
+    }
+    FieldSink<M> fieldSink(metricFor<M>(options));
+    if (!surface || !writer->open(filename, options.width, options.height) ||
+        !fieldSink.open(fields, points, options)) {
+        std::cerr << "Failed to start " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<Uint32> siteColors = mapSiteColors(surface, points);
+    std::vector<Point> spots = showSpots ? toPixelSpace(points, options.view) : std::vector<Point>();
+    SDL_Color spotColor = {0, 0, 0, 255};
+
+    bool ok = renderBands<M>(points, options, bandRows, [&](const std::vector<int> &labels, int y0, int rows) {
+        if (!fieldSink.write(labels, y0, rows)) return false;
+        paintLabels(surface, labels, siteColors);
+        if (!spots.empty()) {
+            PROFILE_STAGE("spots");
+            for (const auto &p: spots) {
+                if (p.y + SPOT_RADIUS >= y0 && p.y - SPOT_RADIUS < y0 + rows) {
+                    drawSpot(surface, static_cast<int>(p.x), static_cast<int>(p.y) - y0, spotColor);
                 }
             }
-
-            Uint32 pixelColor = SDL_MapRGBA(surface->format,
-                                            bestColor.r, bestColor.g, bestColor.b, bestColor.a);
-            pixels[y * WIDTH + x] = pixelColor;
         }
+        // drawSpot clips to the surface, so a spot on the last, shorter band may land in the
+        // unused rows below it; those rows are never written.
+        PROFILE_STAGE("png");
+        return writer->writeRows(surface, rows);
+    });
+    ok = fieldSink.close() && ok;
+    PROFILE_STAGE("png");
+    if (!writer->close() || !ok) {
+        std::cerr << "Failed to write " << filename << std::endl;
+        return false;
     }
+    return true;
+}
 
-    if (showSpots) {
-        std::cout << "Putting spots...\n";
-        SDL_Color spotColor = {0, 0, 0, 255};
-        for (const auto &p: points) {
-            drawSpot(surface, static_cast<int>(p.x), static_cast<int>(p.y), spotColor);
-        }
+template<class L>
+bool generateAllMetricLabelImages(const std::vector<Point> &points,
+                                  const std::array<std::string, 3> &filenames,
+                                  bool showSpots,
+                                  const RenderOptions &options) {
+    std::vector<SDL_Color> colors = labelColors<L>(points);
+    std::vector<Point> pixels = toPixelSpace(points, options.view);
+    auto labels = computeLabelsEach<L, EuclideanMetric, ManhattanMetric, ChebyshevMetric>(pixels, options);
+    bool ok = true;
+    for (size_t m = 0; m < labels.size(); ++m) {
+        ok = saveNarrowLabels(labels[m], colors, pixels, showSpots, filenames[m], options) && ok;
     }
+    return ok;
+}
 
-    IMG_SavePNG(surface, filename.c_str());
-    SDL_FreeSurface(surface);
+// Euclidean, Manhattan and Chebyshev images from one shared setup: the colors are mapped once
+// and the labels of all three come out of a single traversal (see computeLabelsEach).
+bool generateAllMetricImages(const std::vector<Point> &points,
+                             const std::array<std::string, 3> &filenames,
+                             bool showSpots,
+                             const RenderOptions &options,
+                             Canvas &canvas) {
+    if (labelTypeFits<Uint8>(points.size())) {
+        return generateAllMetricLabelImages<Uint8>(points, filenames, showSpots, options);
+    }
+    if (labelTypeFits<Uint16>(points.size())) {
+        return generateAllMetricLabelImages<Uint16>(points, filenames, showSpots, options);
+    }
+
+    SDL_Surface *surface = canvas.get(options.width, options.height);
+    if (!surface) {
+        std::cerr << "Failed to create surface: " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    std::vector<Uint32> siteColors = mapSiteColors(surface, points);
+    std::vector<Point> pixels = toPixelSpace(points, options.view);
+    auto labels = computeLabelsEach<int, EuclideanMetric, ManhattanMetric, ChebyshevMetric>(pixels, options);
+    bool ok = true;
+    for (size_t m = 0; m < labels.size(); ++m) {
+        ok = saveLabels(surface, labels[m], siteColors, pixels, showSpots, filenames[m], options.threads) && ok;
+    }
+    return ok;
 }
 
 void setConsoleColor(WORD color) {
@@ -151,32 +548,138 @@ void colorString(const std::string &_s, const std::string &s, const std::string
     std::cout << s_;
 }
 
-bool loop(std::vector<Point> points) {
+template<class M>
+void editSpots(std::vector<Point> &points, bool showSpots, const RenderOptions &options) {
+    std::cout << "Rendering initial state...\n";
+    RenderState<M> state(points, options.width, options.height, options.threads);
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, options.width, options.height, 32,
+                                                          SDL_PIXELFORMAT_RGBA32);
+    Uint32 *pixels = static_cast<Uint32 *>(surface->pixels);
+    Uint32 noSiteColor = SDL_MapRGBA(surface->format, 0, 0, 0, 255);
+    SDL_Color spotColor = {0, 0, 0, 255};
+
+    for (;;) {
+        const PixelRect &dirty = state.dirty;
+        for (int y = dirty.y0; y < dirty.y1; ++y) {
+            for (int x = dirty.x0; x < dirty.x1; ++x) {
+                size_t i = static_cast<size_t>(y) * state.width + x;
+                int owner = state.labels[i];
+                if (owner < 0) {
+                    pixels[i] = noSiteColor;
+                    continue;
+                }
+                const SDL_Color &c = state.points[owner].color;
+                pixels[i] = SDL_MapRGBA(surface->format, c.r, c.g, c.b, c.a);
+            }
+        }
+        if (showSpots) {
+            for (size_t i = 0; i < state.points.size(); ++i) {
+                if (state.alive[i]) {
+                    drawSpot(surface, static_cast<int>(state.points[i].x), static_cast<int>(state.points[i].y),
+                             spotColor);
+                }
+            }
+        }
+        savePng(surface, "voronoi_edit.png", options.threads);
+
+        std::cout << "Edit spots: a <x> <y> to add, m <index> <x> <y> to move, d <index> to delete, q to finish\n";
+        std::string command;
+        if (!(std::cin >> command) || command == "q") break;
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        int index;
+        double x, y;
+        bool edited = false;
+        if (command == "a") {
+            if (std::cin >> x >> y) {
+                index = state.addSite({x, y, randomColor()});
+                std::cout << "Added spot " << index << "\n";
+                edited = true;
+            }
+        } else if ((command == "m" || command == "d") && std::cin >> index &&
+                   index >= 0 && index < static_cast<int>(state.points.size()) && state.alive[index]) {
+            if (command == "d") {
+                state.deleteSite(index);
+                edited = true;
+            } else if (std::cin >> x >> y) {
+                state.moveSite(index, x, y);
+                edited = true;
+            }
+        }
+        if (!edited) {
+            if (std::cin.eof()) break;
+            // Drop the rest of the line so a bad number is not read back as the next command.
+            std::cin.clear();
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            colorString("", "Unknown edit.", "\n", RED);
+            state.dirty = {};
+            continue;
+        }
+        double ms = 1000.0 * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+        std::cout << "Updated " << (state.dirty.x1 - state.dirty.x0) << "x" << (state.dirty.y1 - state.dirty.y0)
+                  << " px in " << ms << " ms\n";
+    }
+
+    SDL_FreeSurface(surface);
+    points = state.livePoints();
+}
+
+// Reads a whole number for a menu prompt. Anything else is dropped up to the end of the line, so
+// it is not read back as the next choice, and the prompt asks again; false once input runs out.
+bool readNumber(int &value) {
+    int read;
+    while (!(std::cin >> read)) {
+        if (std::cin.eof()) return false;
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        colorString("", "Not a number.", " Try again:\n", RED);
+    }
+    value = read;
+    return true;
+}
+
+// Exit keeps the number it had before the menu grew, so scripted input still quits with 6.
+bool loop(std::vector<Point> &points) {
     static bool showSpots = false;
+    static RenderOptions options;
+    static Canvas canvas;
 
     std::cout << "Choose distance for Voronoi diagram:\n";
+    std::cout << "0. All three at once ◎▣◈\n";
     colorString("1. ", "Euclidean ◎", "\n", CYAN);
     colorString("2. ", "Manhattan ▣", "\n", YELLOW);
     colorString("3. ", "Chebyshev ◈", "\n", PURPLE);
     std::cout << "4. Choose a different point set ⇄\n";
     colorString("5. Toggle spot display (currently ", (showSpots ? "ON" : "OFF"), ") ◉\n", (showSpots ? GREEN : GRAY));
     std::cout << "6. Exit ⌂\n";
+    colorString("7. Switch search mode (currently ", searchModeName(options.mode), ") ⚲\n",
+                (options.mode == SearchMode::BRUTE_FORCE ? GRAY : GREEN));
+    colorString("8. Set render threads (currently ", std::to_string(options.threads), ") ⚙\n", CYAN);
+    std::cout << "9. Edit spots incrementally ✎\n";
 
     int choice;
-    std::cin >> choice;
+    if (!readNumber(choice)) {
+        return false;
+    }
     bool success = true;
 
     switch (choice) {
+        case 0:
+            std::cout << "Every way at once...\n";
+            generateAllMetricImages(points, {"voronoi_euclidean.png", "voronoi_manhattan.png", "voronoi_chebyshev.png"},
+                                    showSpots, options, canvas);
+            break;
         case 1:
-            generateVoronoiImage(points, "voronoi_euclidean.png", euclideanDist, showSpots, "When in Alexandria...\n");
+            generateVoronoiImage<EuclideanMetric>(points, "voronoi_euclidean.png", showSpots,
+                                                  "When in Alexandria...\n", options, canvas);
             break;
         case 2:
-            generateVoronoiImage(points, "voronoi_manhattan.png", manhattanDist, showSpots,
-                                 "It's hip to be square...\n");
+            generateVoronoiImage<ManhattanMetric>(points, "voronoi_manhattan.png", showSpots,
+                                                  "It's hip to be square...\n", options, canvas);
             break;
         case 3:
-            generateVoronoiImage(points, "voronoi_chebyshev.png", chebyshevDist, showSpots,
-                                 "All directions are equal...\n");
+            generateVoronoiImage<ChebyshevMetric>(points, "voronoi_chebyshev.png", showSpots,
+                                                  "All directions are equal...\n", options, canvas);
             break;
         case 4:
             points = loadPoints();
@@ -188,6 +691,28 @@ bool loop(std::vector<Point> points) {
         case 6:
             std::cout << "Quitting...\n";
             return false;
+        case 7:
+            options.mode = nextSearchMode(options.mode);
+            colorString("Search mode is now ", searchModeName(options.mode), "\n",
+                        (options.mode == SearchMode::BRUTE_FORCE ? WHITE : GREEN));
+            break;
+        case 8:
+            std::cout << "Enter the number of render threads:\n";
+            if (!readNumber(options.threads)) return false;
+            options.threads = std::max(1, options.threads);
+            colorString("Render threads set to ", std::to_string(options.threads), "\n", GREEN);
+            break;
+        case 9:
+            std::cout << "Choose distance for editing (1-3):\n";
+            if (!readNumber(choice)) return false;
+            if (choice == 2) {
+                editSpots<ManhattanMetric>(points, showSpots, options);
+            } else if (choice == 3) {
+                editSpots<ChebyshevMetric>(points, showSpots, options);
+            } else {
+                editSpots<EuclideanMetric>(points, showSpots, options);
+            }
+            break;
         default:
             success = 0;
             colorString("", "Unknown choice.", "\nTry again.\n", RED);
@@ -197,17 +722,463 @@ bool loop(std::vector<Point> points) {
     if (success) {
         colorString("", "Done!", "\n", GREEN);
     }
-    return loop(points);
+    return true;
+}
+
+template<class M>
+double timedRender(const std::vector<Point> &points, const std::string &filename, bool showSpots,
+                   const RenderOptions &options, int bandRows, const FieldOutputs &fields, Canvas &canvas,
+                   bool &ok) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    ok = bandRows > 0 ? generateBandedImage<M>(points, filename, showSpots, options, bandRows, canvas, fields)
+                      : generateVoronoiImage<M>(points, filename, showSpots, "", options, canvas, fields);
+    return 1000.0 * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+// One non-interactive render request: a point set, the metrics to draw and where to write them.
+// The view is resolved when the job runs, since --fit needs the points and --view the final size.
+struct BatchJob {
+    std::string input;
+    std::vector<MetricKind> metrics;
+    std::string output = "voronoi_{metric}.png";
+    bool showSpots = false;
+    RenderOptions options;
+    bool fit = false;
+    bool hasWindow = false;
+    double window[4] = {};
+    int bandRows = 0;
+    FieldOutputs fields;
+    int relaxIterations = 0;
+    double relaxTolerance = 0.1;
+    std::string pointsOutput;
+    std::string adjacencyOutput;
+    int frames = 0;
+    double driftSpeed = 1;
+    std::string positions;
+};
+
+// Inserts text before the extension of the file name in path, or at the end if it has none.
+std::string insertBeforeExtension(std::string path, const std::string &text) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+    return path.insert(dot, text);
+}
+
+// Output name for one metric of a job: "{metric}" is replaced by the metric name; without the
+// placeholder a multi-metric job gets "_<metric>" inserted before the extension.
+std::string jobPath(const BatchJob &job, std::string name, MetricKind metric) {
+    size_t at = name.find("{metric}");
+    if (at != std::string::npos) {
+        return name.replace(at, 8, metricName(metric));
+    }
+    if (job.metrics.size() > 1) {
+        name = insertBeforeExtension(name, std::string("_") + metricName(metric));
+    }
+    return name;
+}
+
+// Name of animation frame k: "{frame}" becomes the frame number padded to four digits; without
+// the placeholder "_<number>" goes in before the extension.
+std::string framePath(std::string name, int frame) {
+    char number[16];
+    std::snprintf(number, sizeof(number), "%04d", frame);
+    size_t at = name.find("{frame}");
+    if (at != std::string::npos) {
+        return name.replace(at, 7, number);
+    }
+    return insertBeforeExtension(name, std::string("_") + number);
+}
+
+std::string jobOutput(const BatchJob &job, MetricKind metric) {
+    return jobPath(job, job.output, metric);
+}
+
+FieldOutputs jobFields(const BatchJob &job, MetricKind metric) {
+    FieldOutputs fields;
+    if (!job.fields.labels.empty()) fields.labels = jobPath(job, job.fields.labels, metric);
+    if (!job.fields.distances.empty()) fields.distances = jobPath(job, job.fields.distances, metric);
+    return fields;
+}
+
+// Renders job.frames frames starting from points and saves each one as soon as it is done
+// (see framePath). Frame k > 0 reads its positions from job.positions when that is set;
+// otherwise every site drifts at job.driftSpeed world units per frame in a random direction.
+// The Animator only searches again where the movement could have changed a label.
+template<class M>
+double timedAnimation(const BatchJob &job, const std::vector<Point> &points, const std::string &output,
+                      const RenderOptions &options, Canvas &canvas, bool &ok) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Surface *surface = canvas.get(options.width, options.height);
+    if (!surface) {
+        std::cerr << "Failed to create surface: " << SDL_GetError() << std::endl;
+        ok = false;
+        return 0;
+    }
+    std::vector<Uint32> siteColors = mapSiteColors(surface, points);
+    std::vector<Velocity> velocities(points.size());
+    for (auto &v: velocities) {
+        double angle = 2 * std::acos(-1.0) * rand() / RAND_MAX;
+        v = {job.driftSpeed * std::cos(angle), job.driftSpeed * std::sin(angle)};
+    }
+
+    Animator<M> animator(options);
+    std::vector<Point> frame = points;
+    ok = true;
+    for (int k = 0; k < job.frames && ok; ++k) {
+        if (k > 0 && job.positions.empty()) {
+            advancePoints(frame, velocities, 1.0);
+        } else if (k > 0) {
+            std::string path = framePath(job.positions, k);
+            std::vector<Point> moved = loadPoints(path);
+            if (moved.size() != frame.size()) {
+                std::cerr << path << " has " << moved.size() << " spots, expected " << frame.size() << std::endl;
+                ok = false;
+                break;
+            }
+            for (size_t i = 0; i < frame.size(); ++i) {
+                frame[i].x = moved[i].x;
+                frame[i].y = moved[i].y;
+            }
+        }
+
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        const std::vector<int> &labels = animator.render(frame);
+        double renderMs = 1000.0 * (SDL_GetPerformanceCounter() - frameStart) / SDL_GetPerformanceFrequency();
+        std::string path = framePath(output, k);
+        std::vector<Point> pixels = toPixelSpace(frame, options.view);
+        ok = saveLabels(surface, labels, siteColors, pixels, job.showSpots, path, options.threads,
+                        smoothBorders<M>(pixels, labels, options));
+        std::cout << "Frame " << k << ": searched " << animator.lastVerified() << " of " << labels.size()
+                  << " px in " << renderMs << " ms -> " << path << "\n";
+    }
+    return 1000.0 * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+// Parses "<input> [--metric m[,m...]|all] [--size WxH] [--view x0,y0,x1,y1 | --fit] [--band rows]
+// [--spots] [--mode name] [--threads n] [--out path] [--labels path] [--distances path]
+// [--relax iterations] [--relax-tolerance pixels] [--save-points path] [--delaunay path] [--p exponent]
+// [--frames n] [--drift speed] [--positions pattern] [--antialias samples]".
+bool parseJob(const std::vector<std::string> &args, BatchJob &job, std::string &error) {
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string &arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        if (arg == "--spots") {
+            job.showSpots = true;
+        } else if (arg == "--metric" && hasValue) {
+            std::stringstream list(args[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) {
+                MetricKind metric;
+                if (name == "all") {
+                    job.metrics = {MetricKind::EUCLIDEAN, MetricKind::MANHATTAN, MetricKind::CHEBYSHEV};
+                } else if (parseMetric(name, metric)) {
+                    job.metrics.push_back(metric);
+                } else {
+                    error = "unknown metric '" + name + "'";
+                    return false;
+                }
+            }
+        } else if (arg == "--size" && hasValue) {
+            char x = 0;
+            std::istringstream size(args[++i]);
+            if (!(size >> job.options.width >> x >> job.options.height) || x != 'x' ||
+                job.options.width <= 0 || job.options.height <= 0) {
+                error = "bad size '" + args[i] + "', expected WxH";
+                return false;
+            }
+        } else if (arg == "--view" && hasValue) {
+            char c1 = 0, c2 = 0, c3 = 0;
+            std::istringstream view(args[++i]);
+            double *w = job.window;
+            if (!(view >> w[0] >> c1 >> w[1] >> c2 >> w[2] >> c3 >> w[3]) || c1 != ',' || c2 != ',' || c3 != ',' ||
+                w[2] <= w[0] || w[3] <= w[1]) {
+                error = "bad view '" + args[i] + "', expected minX,minY,maxX,maxY";
+                return false;
+            }
+            job.hasWindow = true;
+        } else if (arg == "--fit") {
+            job.fit = true;
+        } else if (arg == "--band" && hasValue) {
+            job.bandRows = std::atoi(args[++i].c_str());
+            if (job.bandRows <= 0) {
+                error = "bad band height '" + args[i] + "'";
+                return false;
+            }
+        } else if (arg == "--p" && hasValue) {
+            job.options.lpExponent = std::atof(args[++i].c_str());
+            if (!(job.options.lpExponent > 0)) {
+                error = "bad Minkowski exponent '" + args[i] + "'";
+                return false;
+            }
+        } else if (arg == "--mode" && hasValue) {
+            if (!parseSearchMode(args[++i], job.options.mode)) {
+                error = "unknown search mode '" + args[i] + "'";
+                return false;
+            }
+        } else if (arg == "--threads" && hasValue) {
+            job.options.threads = std::max(1, std::atoi(args[++i].c_str()));
+        } else if (arg == "--out" && hasValue) {
+            job.output = args[++i];
+        } else if (arg == "--relax" && hasValue) {
+            job.relaxIterations = std::atoi(args[++i].c_str());
+            if (job.relaxIterations <= 0) {
+                error = "bad relaxation iteration count '" + args[i] + "'";
+                return false;
+            }
+        } else if (arg == "--relax-tolerance" && hasValue) {
+            job.relaxTolerance = std::atof(args[++i].c_str());
+        } else if (arg == "--save-points" && hasValue) {
+            job.pointsOutput = args[++i];
+        } else if (arg == "--delaunay" && hasValue) {
+            job.adjacencyOutput = args[++i];
+        } else if (arg == "--frames" && hasValue) {
+            job.frames = std::atoi(args[++i].c_str());
+            if (job.frames <= 0) {
+                error = "bad frame count '" + args[i] + "'";
+                return false;
+            }
+        } else if (arg == "--drift" && hasValue) {
+            job.driftSpeed = std::atof(args[++i].c_str());
+        } else if (arg == "--positions" && hasValue) {
+            job.positions = args[++i];
+        } else if (arg == "--antialias" && hasValue) {
+            job.options.antialias = std::atoi(args[++i].c_str());
+            if (job.options.antialias < 2) {
+                error = "bad anti-aliasing sample count '" + args[i] + "', expected at least 2";
+                return false;
+            }
+        } else if (arg == "--labels" && hasValue) {
+            job.fields.labels = args[++i];
+        } else if (arg == "--distances" && hasValue) {
+            job.fields.distances = args[++i];
+        } else if (arg.rfind("--", 0) != 0 && job.input.empty()) {
+            job.input = arg;
+        } else {
+            error = "unexpected argument '" + arg + "'";
+            return false;
+        }
+    }
+    if (job.input.empty()) {
+        error = "no input file";
+        return false;
+    }
+    if (job.frames > 0 && (job.bandRows > 0 || !job.fields.labels.empty() || !job.fields.distances.empty())) {
+        error = "animations are rendered whole and have no field outputs";
+        return false;
+    }
+    if (job.options.antialias > 0 && job.bandRows > 0) {
+        error = "anti-aliasing needs the whole image and cannot run in bands";
+        return false;
+    }
+    if (job.metrics.empty()) {
+        job.metrics.push_back(MetricKind::EUCLIDEAN);
+    }
+    return true;
+}
+
+// Reads one job per line; blank lines and lines starting with '#' are skipped.
+bool readJobFile(const std::string &filename, std::vector<BatchJob> &jobs) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << filename << std::endl;
+        return false;
+    }
+    bool ok = true;
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        std::istringstream tokens(line);
+        std::vector<std::string> args;
+        for (std::string token; tokens >> token;) args.push_back(token);
+        if (args.empty() || args[0][0] == '#') continue;
+
+        BatchJob job;
+        std::string error;
+        if (parseJob(args, job, error)) {
+            jobs.push_back(job);
+        } else {
+            std::cerr << filename << ":" << lineNumber << ": " << error << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Runs every job in one process. Point sets are loaded once per input file and the output
+// surface is reused while the resolution stays the same.
+bool runJobs(const std::vector<BatchJob> &jobs) {
+    std::map<std::string, std::vector<Point>> pointSets;
+    Canvas canvas;
+    int failed = 0;
+    int renders = 0;
+    double totalMs = 0;
+
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        const BatchJob &job = jobs[j];
+        auto loaded = pointSets.find(job.input);
+        if (loaded == pointSets.end()) {
+            loaded = pointSets.emplace(job.input, loadPoints(job.input)).first;
+        }
+        const std::vector<Point> &points = loaded->second;
+        if (points.empty()) {
+            std::cerr << "Job " << j + 1 << ": no spots in " << job.input << std::endl;
+            ++failed;
+            continue;
+        }
+
+        RenderOptions options = job.options;
+        if (job.fit) {
+            options.view = fitView(points, options.width, options.height);
+        } else if (job.hasWindow) {
+            options.view = windowView(job.window[0], job.window[1], job.window[2], job.window[3],
+                                      options.width, options.height);
+        }
+
+        // The shared three-metric pass has no field or site outputs and relaxation moves the
+        // sites per metric, so jobs asking for any of them, for an animation or for anti-aliasing
+        // render each metric on its own.
+        bool allMetrics = job.bandRows == 0 && job.fields.labels.empty() && job.fields.distances.empty() &&
+                          job.relaxIterations == 0 && job.pointsOutput.empty() && job.adjacencyOutput.empty() &&
+                          job.frames == 0 && options.antialias == 0;
+        for (MetricKind metric: {MetricKind::EUCLIDEAN, MetricKind::MANHATTAN, MetricKind::CHEBYSHEV}) {
+            allMetrics = allMetrics && std::find(job.metrics.begin(), job.metrics.end(), metric) != job.metrics.end();
+        }
+        if (allMetrics && job.metrics.size() == 3) {
+            std::array<std::string, 3> outputs = {jobOutput(job, MetricKind::EUCLIDEAN),
+                                                  jobOutput(job, MetricKind::MANHATTAN),
+                                                  jobOutput(job, MetricKind::CHEBYSHEV)};
+            Uint64 start = SDL_GetPerformanceCounter();
+            bool ok = generateAllMetricImages(points, outputs, job.showSpots, options, canvas);
+            double ms = 1000.0 * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+            renders += 3;
+            totalMs += ms;
+            if (!ok) ++failed;
+            std::cout << "Job " << j + 1 << ": all metrics " << options.width << "x" << options.height
+                      << " " << searchModeName(options.mode) << " -> " << outputs[0] << ", " << outputs[1]
+                      << ", " << outputs[2] << (ok ? "" : " FAILED") << " in " << ms << " ms\n";
+            continue;
+        }
+
+        for (MetricKind metric: job.metrics) {
+            std::string output = jobOutput(job, metric);
+            FieldOutputs fields = jobFields(job, metric);
+            std::vector<Point> relaxed;
+            const std::vector<Point> &sites = job.relaxIterations > 0 ? relaxed : points;
+            if (job.relaxIterations > 0) {
+                relaxed = points;
+                RelaxResult relax = withMetric(metric, options.lpExponent, [&](auto m) {
+                    return relaxPoints<decltype(m)>(relaxed, options, job.relaxIterations, job.relaxTolerance);
+                });
+                std::cout << "Job " << j + 1 << ": " << metricName(metric) << " relaxed in " << relax.iterations
+                          << " iterations, last max shift " << relax.maxShift << " px\n";
+            }
+            if (!job.pointsOutput.empty() && !writePointFile(jobPath(job, job.pointsOutput, metric), sites, true)) {
+                std::cerr << "Failed to write " << jobPath(job, job.pointsOutput, metric) << std::endl;
+                ++failed;
+            }
+            if (!job.adjacencyOutput.empty() && !writeAdjacency(jobPath(job, job.adjacencyOutput, metric), sites)) {
+                std::cerr << "Failed to write " << jobPath(job, job.adjacencyOutput, metric) << std::endl;
+                ++failed;
+            }
+            bool ok = false;
+            double ms = withMetric(metric, options.lpExponent, [&](auto m) {
+                using M = decltype(m);
+                return job.frames > 0 ? timedAnimation<M>(job, sites, output, options, canvas, ok)
+                                      : timedRender<M>(sites, output, job.showSpots, options, job.bandRows, fields,
+                                                       canvas, ok);
+            });
+            renders += std::max(1, job.frames);
+            totalMs += ms;
+            if (!ok) ++failed;
+            std::cout << "Job " << j + 1 << ": " << metricName(metric) << " " << options.width << "x"
+                      << options.height << " " << searchModeName(options.mode)
+                      << (job.bandRows > 0 ? " banded" : "") << " -> " << output
+                      << (job.frames > 0 ? " (" + std::to_string(job.frames) + " frames)" : "")
+                      << (ok ? "" : " FAILED") << " in " << ms << " ms\n";
+        }
+    }
+
+    std::cout << renders << " renders in " << totalMs / 1000.0 << " s, " << failed << " failed\n";
+    return failed == 0;
+}
+
+void printUsage() {
+    std::cout << "Usage:\n"
+                 "  main                                   interactive menu\n"
+                 "  main --render <input> [options]        render one job\n"
+                 "  main --jobs <file>                     render one job per line of <file>\n"
+                 "  main --convert <input.json> <output>   write a binary point file\n"
+                 "  main --profile <report.json> ...       any of the above, then the per-stage report as JSON\n"
+                 "                                         (needs a build with -DVORONOI_PROFILE)\n"
+                 "Job options:\n"
+                 "  --metric euclidean|manhattan|chebyshev|minkowski|power|additive[,...]|all\n"
+                 "      (power and additive weight each spot by its optional \"weight\", a length; all is\n"
+                 "       the three unweighted metrics)\n"
+                 "  --p exponent   (Lp exponent for minkowski, any p > 0 or inf; default 3)\n"
+                 "  --size WxH   --spots   --threads N   --out path ({metric} is replaced)\n"
+                 "  --view minX,minY,maxX,maxY   --fit   (world area shown; default is 1 unit per pixel)\n"
+                 "  --band rows  (render in bands of this many rows, streamed to the PNG, or PPM for .ppm names)\n"
+                 "  --labels path   --distances path   (raw uint32 site index / float32 distance per pixel)\n"
+                 "  --relax N   --relax-tolerance px   (Lloyd relaxation before rendering, default 0.1 px)\n"
+                 "  --save-points path   (write the rendered, possibly relaxed, sites as a binary point file)\n"
+                 "  --delaunay path   (write the Delaunay neighbours of every site, one line per site)\n"
+                 "  --frames N   (animation: N frames named by --out, {frame} is replaced by the frame number)\n"
+                 "  --drift speed   (world units per frame each spot drifts in a random direction, default 1)\n"
+                 "  --positions pattern   (read the spots of frame k > 0 from pattern, {frame} replaced)\n"
+                 "  --antialias N   (supersample pixels on cell borders N x N and blend the colors; try 4)\n"
+                 "  --mode brute|grid|simd|scanline|fortune|jfa|jfa-check|quadtree\n";
+}
+
+int runBatch(int argc, char *argv[]) {
+    std::string command = argv[1];
+    std::vector<BatchJob> jobs;
+    if (command == "--jobs" && argc == 3) {
+        if (!readJobFile(argv[2], jobs)) return 1;
+    } else if (command == "--render" && argc >= 3) {
+        BatchJob job;
+        std::string error;
+        if (!parseJob(std::vector<std::string>(argv + 2, argv + argc), job, error)) {
+            std::cerr << error << std::endl;
+            printUsage();
+            return 1;
+        }
+        jobs.push_back(job);
+    } else {
+        printUsage();
+        return 1;
+    }
+    return runJobs(jobs) ? 0 : 1;
 }
 
 int main(int argc, char *argv[]) {
     SetConsoleOutputCP(CP_UTF8);
+    std::string profilePath;
+    if (argc >= 3 && std::string(argv[1]) == "--profile") {
+        profilePath = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc == 4 && std::string(argv[1]) == "--convert") {
+        return convertPoints(argv[2], argv[3]);
+    }
     if (SDL_Init(SDL_INIT_VIDEO) != 0 || IMG_Init(IMG_INIT_PNG) != IMG_INIT_PNG) {
         std::cerr << "SDL init failed: " << SDL_GetError() << std::endl;
         return 1;
     }
-    while (loop(loadPoints()));
+    srand(time(nullptr));
+
+    int status = 0;
+    {
+        PROFILE_STAGE("run");
+        if (argc > 1) {
+            status = runBatch(argc, argv);
+        } else {
+            std::vector<Point> points = loadPoints();
+            while (loop(points));
+        }
+    }
+    if (!profile::report(profilePath)) status = 1;
     IMG_Quit();
     SDL_Quit();
-    return 0;
+    return status;
 }
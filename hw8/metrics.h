@@ -0,0 +1,372 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include "point.h"
+#include "profile.h"
+
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// Metric policies. key() is any value with the same ordering as the distance, so the renderers
+// compare keys and only convert back with distance() when a real distance is needed. Every key
+// is monotone in |dx| and |dy|, which the grid search relies on for its lower bounds. WEIGHTED
+// policies also take the site's weight and their keys only ever fall as the weight grows, so a
+// bound computed with the largest weight holds for every site (see siteKey). Searches take the
+// policy as a value; all but MinkowskiMetric are empty and default-constructed when none is given.
+
+inline __m128 abs4(__m128 v) {
+    return _mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)));
+}
+
+inline TARGET_AVX2 __m256 abs8(__m256 v) {
+    return _mm256_and_ps(v, _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF)));
+}
+
+// x^P by repeated squaring and multiplication, in the same order for every lane width.
+template<int P>
+float powInt(float x) {
+    if constexpr (P == 1) {
+        return x;
+    } else if constexpr (P % 2 == 0) {
+        float half = powInt<P / 2>(x);
+        return half * half;
+    } else {
+        return powInt<P - 1>(x) * x;
+    }
+}
+
+template<int P>
+__m128 powInt(__m128 x) {
+    if constexpr (P == 1) {
+        return x;
+    } else if constexpr (P % 2 == 0) {
+        __m128 half = powInt<P / 2>(x);
+        return _mm_mul_ps(half, half);
+    } else {
+        return _mm_mul_ps(powInt<P - 1>(x), x);
+    }
+}
+
+template<int P>
+TARGET_AVX2 __m256 powInt(__m256 x) {
+    if constexpr (P == 1) {
+        return x;
+    } else if constexpr (P % 2 == 0) {
+        __m256 half = powInt<P / 2>(x);
+        return _mm256_mul_ps(half, half);
+    } else {
+        return _mm256_mul_ps(powInt<P - 1>(x), x);
+    }
+}
+
+// log2 and exp2 approximations for MinkowskiMetric, good to a few float ulps. log2 splits off
+// the exponent and runs an atanh series on the mantissa centred on 1; exp2 rounds to the nearest
+// integer power of two and runs a Taylor series on the remaining [-0.5, 0.5]. The scalar and
+// vector forms perform the same float operations in the same order, so every search mode
+// compares bit-identical keys. Inputs of log2 below FLT_MIN are treated as FLT_MIN and exp2
+// clamps to [2^-126, 2^127].
+const float LOG2_C1 = 2.88539008f;
+const float LOG2_C3 = 0.961796694f;
+const float LOG2_C5 = 0.577078016f;
+const float LOG2_C7 = 0.412198583f;
+const float EXP2_C1 = 0.693147181f;
+const float EXP2_C2 = 0.240226507f;
+const float EXP2_C3 = 0.0555041087f;
+const float EXP2_C4 = 0.00961812911f;
+const float EXP2_C5 = 0.00133335581f;
+const float EXP2_C6 = 0.000154035304f;
+const float EXP2_C7 = 0.0000152527338f;
+const float SQRT_2 = 1.41421356f;
+
+inline float fastLog2(float x) {
+    x = std::max(x, std::numeric_limits<float>::min());
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    float e = static_cast<float>(static_cast<int>(bits >> 23) - 127);
+    bits = (bits & 0x007FFFFF) | 0x3F800000;
+    float m;
+    std::memcpy(&m, &bits, sizeof(m));
+    if (m > SQRT_2) {
+        m *= 0.5f;
+        e += 1.0f;
+    }
+    float t = (m - 1.0f) / (m + 1.0f);
+    float t2 = t * t;
+    return e + t * (LOG2_C1 + t2 * (LOG2_C3 + t2 * (LOG2_C5 + t2 * LOG2_C7)));
+}
+
+inline __m128 fastLog2(__m128 x) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128i bits = _mm_castps_si128(_mm_max_ps(x, _mm_set1_ps(std::numeric_limits<float>::min())));
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)),
+                                             _mm_set1_epi32(0x3F800000)));
+    __m128 high = _mm_cmpgt_ps(m, _mm_set1_ps(SQRT_2));
+    m = _mm_or_ps(_mm_and_ps(high, _mm_mul_ps(m, _mm_set1_ps(0.5f))), _mm_andnot_ps(high, m));
+    e = _mm_add_ps(e, _mm_and_ps(high, one));
+    __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 poly = _mm_add_ps(_mm_set1_ps(LOG2_C5), _mm_mul_ps(t2, _mm_set1_ps(LOG2_C7)));
+    poly = _mm_add_ps(_mm_set1_ps(LOG2_C3), _mm_mul_ps(t2, poly));
+    poly = _mm_add_ps(_mm_set1_ps(LOG2_C1), _mm_mul_ps(t2, poly));
+    return _mm_add_ps(e, _mm_mul_ps(t, poly));
+}
+
+inline TARGET_AVX2 __m256 fastLog2(__m256 x) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256i bits = _mm256_castps_si256(_mm256_max_ps(x, _mm256_set1_ps(std::numeric_limits<float>::min())));
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+                                                   _mm256_set1_epi32(0x3F800000)));
+    __m256 high = _mm256_cmp_ps(m, _mm256_set1_ps(SQRT_2), _CMP_GT_OQ);
+    m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), high);
+    e = _mm256_add_ps(e, _mm256_and_ps(high, one));
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 poly = _mm256_add_ps(_mm256_set1_ps(LOG2_C5), _mm256_mul_ps(t2, _mm256_set1_ps(LOG2_C7)));
+    poly = _mm256_add_ps(_mm256_set1_ps(LOG2_C3), _mm256_mul_ps(t2, poly));
+    poly = _mm256_add_ps(_mm256_set1_ps(LOG2_C1), _mm256_mul_ps(t2, poly));
+    return _mm256_add_ps(e, _mm256_mul_ps(t, poly));
+}
+
+inline float fastExp2(float y) {
+    y = std::min(std::max(y, -126.0f), 127.0f);
+    int i = _mm_cvtss_si32(_mm_set_ss(y));
+    float f = y - static_cast<float>(i);
+    float poly = EXP2_C1 + f * (EXP2_C2 + f * (EXP2_C3 + f * (EXP2_C4 + f * (EXP2_C5 + f * (EXP2_C6 + f * EXP2_C7)))));
+    uint32_t bits = static_cast<uint32_t>(i + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return (1.0f + f * poly) * scale;
+}
+
+inline __m128 fastExp2(__m128 y) {
+    y = _mm_min_ps(_mm_max_ps(y, _mm_set1_ps(-126.0f)), _mm_set1_ps(127.0f));
+    __m128i i = _mm_cvtps_epi32(y);
+    __m128 f = _mm_sub_ps(y, _mm_cvtepi32_ps(i));
+    __m128 poly = _mm_set1_ps(EXP2_C7);
+    for (float c: {EXP2_C6, EXP2_C5, EXP2_C4, EXP2_C3, EXP2_C2, EXP2_C1}) {
+        poly = _mm_add_ps(_mm_set1_ps(c), _mm_mul_ps(f, poly));
+    }
+    __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(_mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(f, poly)), scale);
+}
+
+inline TARGET_AVX2 __m256 fastExp2(__m256 y) {
+    y = _mm256_min_ps(_mm256_max_ps(y, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(127.0f));
+    __m256i i = _mm256_cvtps_epi32(y);
+    __m256 f = _mm256_sub_ps(y, _mm256_cvtepi32_ps(i));
+    __m256 poly = _mm256_set1_ps(EXP2_C7);
+    for (float c: {EXP2_C6, EXP2_C5, EXP2_C4, EXP2_C3, EXP2_C2, EXP2_C1}) {
+        poly = _mm256_add_ps(_mm256_set1_ps(c), _mm256_mul_ps(f, poly));
+    }
+    __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(i, _mm256_set1_epi32(127)), 23));
+    return _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(f, poly)), scale);
+}
+
+struct EuclideanMetric {
+    static constexpr bool WEIGHTED = false;
+
+    static float key(float dx, float dy) {
+        return dx * dx + dy * dy;
+    }
+
+    static __m128 key(__m128 dx, __m128 dy) {
+        return _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    }
+
+    static TARGET_AVX2 __m256 key(__m256 dx, __m256 dy) {
+        return _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    }
+
+    static float keyOf(float dist) {
+        return dist * dist;
+    }
+
+    static float distance(float key) {
+        return std::sqrt(key);
+    }
+};
+
+struct ManhattanMetric {
+    static constexpr bool WEIGHTED = false;
+
+    static float key(float dx, float dy) {
+        return std::abs(dx) + std::abs(dy);
+    }
+
+    static __m128 key(__m128 dx, __m128 dy) {
+        return _mm_add_ps(abs4(dx), abs4(dy));
+    }
+
+    static TARGET_AVX2 __m256 key(__m256 dx, __m256 dy) {
+        return _mm256_add_ps(abs8(dx), abs8(dy));
+    }
+
+    static float keyOf(float dist) {
+        return dist;
+    }
+
+    static float distance(float key) {
+        return key;
+    }
+};
+
+struct ChebyshevMetric {
+    static constexpr bool WEIGHTED = false;
+
+    static float key(float dx, float dy) {
+        return std::max(std::abs(dx), std::abs(dy));
+    }
+
+    static __m128 key(__m128 dx, __m128 dy) {
+        return _mm_max_ps(abs4(dx), abs4(dy));
+    }
+
+    static TARGET_AVX2 __m256 key(__m256 dx, __m256 dy) {
+        return _mm256_max_ps(abs8(dx), abs8(dy));
+    }
+
+    static float keyOf(float dist) {
+        return dist;
+    }
+
+    static float distance(float key) {
+        return key;
+    }
+};
+
+// Lp distance for a whole exponent P > 2, keyed by |dx|^P + |dy|^P with multiplications only.
+// Keys overflow to infinity once a distance passes FLT_MAX^(1/P), about 65,000 px at P = 8, and
+// such sites count as out of range, so withLpMetric only takes this path up to P = 8.
+template<int P>
+struct LpMetric {
+    static_assert(P > 2, "p = 1 and 2 have their own policies");
+    static constexpr bool WEIGHTED = false;
+
+    static float key(float dx, float dy) {
+        return powInt<P>(std::abs(dx)) + powInt<P>(std::abs(dy));
+    }
+
+    static __m128 key(__m128 dx, __m128 dy) {
+        return _mm_add_ps(powInt<P>(abs4(dx)), powInt<P>(abs4(dy)));
+    }
+
+    static TARGET_AVX2 __m256 key(__m256 dx, __m256 dy) {
+        return _mm256_add_ps(powInt<P>(abs8(dx)), powInt<P>(abs8(dy)));
+    }
+
+    static float keyOf(float dist) {
+        return powInt<P>(dist);
+    }
+
+    static float distance(float key) {
+        return std::pow(key, 1.0f / P);
+    }
+};
+
+// Lp distance for any exponent p > 0, which the instance carries, so renders with different
+// exponents can run side by side. There is no default exponent: a search that is not handed an
+// instance does not compile for this policy. The key is the distance itself, written as
+// m * (1 + (n / m)^p)^(1/p) with m and n the larger and smaller of |dx| and |dy| so that neither
+// power can overflow, and both powers go through fastLog2 and fastExp2. Their error is a few
+// ulps, far below the gap between the two closest sites of any pixel that is not an exact tie.
+struct MinkowskiMetric {
+    static constexpr bool WEIGHTED = false;
+    float exponent;
+    float inverse;
+
+    explicit MinkowskiMetric(float p) : exponent(p), inverse(1.0f / p) {}
+
+    float key(float dx, float dy) const {
+        float ax = std::abs(dx), ay = std::abs(dy);
+        float m = std::max(ax, ay);
+        float r = std::min(ax, ay) / std::max(m, std::numeric_limits<float>::min());
+        float t = fastExp2(exponent * fastLog2(r));
+        return m * fastExp2(inverse * fastLog2(1.0f + t));
+    }
+
+    __m128 key(__m128 dx, __m128 dy) const {
+        __m128 ax = abs4(dx), ay = abs4(dy);
+        __m128 m = _mm_max_ps(ax, ay);
+        __m128 r = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(m, _mm_set1_ps(std::numeric_limits<float>::min())));
+        __m128 t = fastExp2(_mm_mul_ps(_mm_set1_ps(exponent), fastLog2(r)));
+        return _mm_mul_ps(m, fastExp2(_mm_mul_ps(_mm_set1_ps(inverse), fastLog2(_mm_add_ps(_mm_set1_ps(1.0f), t)))));
+    }
+
+    TARGET_AVX2 __m256 key(__m256 dx, __m256 dy) const {
+        __m256 ax = abs8(dx), ay = abs8(dy);
+        __m256 m = _mm256_max_ps(ax, ay);
+        __m256 r = _mm256_div_ps(_mm256_min_ps(ax, ay),
+                                 _mm256_max_ps(m, _mm256_set1_ps(std::numeric_limits<float>::min())));
+        __m256 t = fastExp2(_mm256_mul_ps(_mm256_set1_ps(exponent), fastLog2(r)));
+        return _mm256_mul_ps(m, fastExp2(_mm256_mul_ps(_mm256_set1_ps(inverse),
+                                                       fastLog2(_mm256_add_ps(_mm256_set1_ps(1.0f), t)))));
+    }
+
+    static float keyOf(float dist) {
+        return dist;
+    }
+
+    static float distance(float key) {
+        return key;
+    }
+};
+
+// Power diagram: the weight is the radius of a circle around the site and the key is the power
+// of the point with respect to that circle, d^2 - w^2. Cells are convex but need not contain
+// their site, and a site can own nothing at all. A negative weight acts as an imaginary radius
+// and shrinks the cell instead. There are no vector kernels, so SIMD mode uses the grid.
+struct PowerMetric {
+    static constexpr bool WEIGHTED = true;
+
+    static float key(float dx, float dy, float weight) {
+        return dx * dx + dy * dy - weight * std::abs(weight);
+    }
+
+    static float keyOf(float dist) {
+        return dist * dist;
+    }
+
+    // Signed square root, so a point inside the circle gets a negative distance.
+    static float distance(float key) {
+        return key < 0 ? -std::sqrt(-key) : std::sqrt(key);
+    }
+};
+
+// Additively weighted (Apollonius) diagram: the key is d - w, the distance to a circle of radius
+// w around the site. Cells are star-shaped around their site with hyperbolic edges.
+struct AdditiveMetric {
+    static constexpr bool WEIGHTED = true;
+
+    static float key(float dx, float dy, float weight) {
+        return std::sqrt(dx * dx + dy * dy) - weight;
+    }
+
+    static float keyOf(float dist) {
+        return dist;
+    }
+
+    static float distance(float key) {
+        return key;
+    }
+};
+
+// Key of a site with the given weight under any policy; the unweighted ones ignore the weight.
+template<class M>
+float siteKey(float dx, float dy, float weight, const M &metric = M()) {
+    PROFILE_DISTANCES(1);
+    if constexpr (M::WEIGHTED) {
+        return metric.key(dx, dy, weight);
+    } else {
+        return metric.key(dx, dy);
+    }
+}
@@ -0,0 +1,515 @@
+#pragma once
+
+#include <SDL.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+#include "profile.h"
+#include "rowwriter.h"
+
+// Streaming PNG encoder. Rows are filtered and deflated in independent chunks on worker threads
+// while the caller keeps rendering; each chunk becomes one IDAT holding a complete deflate block
+// that ends on a byte boundary (an empty stored block, as zlib's Z_SYNC_FLUSH does), so the
+// chunks concatenate into a single valid zlib stream. The Adler-32 checksums of the chunks are
+// combined at the end. Voronoi images are flat, so after filtering most of a row is long runs
+// that the matcher below turns into a few back-references.
+
+namespace png {
+
+inline uint32_t crc32(uint32_t crc, const Uint8 *data, size_t size) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+const uint32_t ADLER_BASE = 65521;
+
+inline uint32_t adler32(const Uint8 *data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t block = std::min<size_t>(size, 5552);
+        size -= block;
+        for (size_t i = 0; i < block; ++i) {
+            a += data[i];
+            b += a;
+        }
+        data += block;
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+    return a | b << 16;
+}
+
+// Checksum of the concatenation of two buffers from their checksums and the second length.
+inline uint32_t adler32Combine(uint32_t first, uint32_t second, uint64_t secondSize) {
+    uint32_t rem = static_cast<uint32_t>(secondSize % ADLER_BASE);
+    uint32_t sum1 = first & 0xFFFF;
+    uint32_t sum2 = static_cast<uint32_t>(static_cast<uint64_t>(rem) * sum1 % ADLER_BASE);
+    sum1 += (second & 0xFFFF) + ADLER_BASE - 1;
+    sum2 += (first >> 16) + (second >> 16) + ADLER_BASE - rem;
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum2 >= 2 * ADLER_BASE) sum2 -= 2 * ADLER_BASE;
+    if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+    return sum1 | sum2 << 16;
+}
+
+// LSB-first bit packer for deflate output.
+class BitWriter {
+public:
+    explicit BitWriter(std::string &out) : out(out) {}
+
+    void bits(uint32_t value, int count) {
+        buffer |= static_cast<uint64_t>(value) << used;
+        used += count;
+        while (used >= 8) {
+            out.push_back(static_cast<char>(buffer & 0xFF));
+            buffer >>= 8;
+            used -= 8;
+        }
+    }
+
+    // Huffman codes are defined MSB-first.
+    void code(uint32_t value, int count) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < count; ++i) reversed |= ((value >> i) & 1) << (count - 1 - i);
+        bits(reversed, count);
+    }
+
+    void align() {
+        if (used > 0) bits(0, 8 - used);
+    }
+
+private:
+    std::string &out;
+    uint64_t buffer = 0;
+    int used = 0;
+};
+
+const int LENGTH_BASE[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                           67, 83, 99, 115, 131, 163, 195, 227, 258};
+const int LENGTH_EXTRA[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const int DIST_BASE[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                         1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const int DIST_EXTRA[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12,
+                          13, 13};
+
+// A literal when length is 0, otherwise a back-reference of length bytes at distance value.
+struct Token {
+    uint16_t length;
+    uint16_t value;
+};
+
+inline int lengthSymbol(int length) {
+    int l = 28;
+    while (LENGTH_BASE[l] > length) --l;
+    return l;
+}
+
+inline int distSymbol(int distance) {
+    int d = 29;
+    while (DIST_BASE[d] > distance) --d;
+    return d;
+}
+
+// Huffman code lengths for the given frequencies, no longer than limit. When the tree comes out
+// too deep the frequencies are halved (keeping used symbols at 1) and it is rebuilt. Alphabets
+// with a single used symbol get a second one so the code stays complete.
+inline std::vector<int> codeLengths(std::vector<uint32_t> freq, int limit) {
+    size_t n = freq.size();
+    std::vector<int> lengths(n, 0);
+    int used = 0;
+    for (auto f: freq) used += f > 0;
+    if (used == 0) return lengths;
+    if (used == 1) {
+        for (size_t i = 0; i < n; ++i) {
+            if (freq[i] == 0) {
+                freq[i] = 1;
+                break;
+            }
+        }
+    }
+
+    for (;;) {
+        // Nodes 0..n-1 are leaves; parents are appended as the two lightest nodes merge.
+        std::vector<uint64_t> weight;
+        std::vector<int> parent;
+        using Item = std::pair<uint64_t, int>;
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+        for (size_t i = 0; i < n; ++i) {
+            weight.push_back(freq[i]);
+            parent.push_back(-1);
+            if (freq[i] > 0) heap.push({freq[i], static_cast<int>(i)});
+        }
+        while (heap.size() > 1) {
+            Item x = heap.top();
+            heap.pop();
+            Item y = heap.top();
+            heap.pop();
+            int node = static_cast<int>(weight.size());
+            weight.push_back(x.first + y.first);
+            parent.push_back(-1);
+            parent[x.second] = node;
+            parent[y.second] = node;
+            heap.push({x.first + y.first, node});
+        }
+
+        int deepest = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (freq[i] == 0) {
+                lengths[i] = 0;
+                continue;
+            }
+            int depth = 0;
+            for (int node = static_cast<int>(i); parent[node] != -1; node = parent[node]) ++depth;
+            lengths[i] = depth;
+            deepest = std::max(deepest, depth);
+        }
+        if (deepest <= limit) return lengths;
+        for (auto &f: freq) {
+            if (f > 0) f = std::max<uint32_t>(1, f / 2);
+        }
+    }
+}
+
+// Canonical codes from code lengths (RFC 1951, 3.2.2).
+inline std::vector<uint32_t> canonicalCodes(const std::vector<int> &lengths) {
+    int maxBits = *std::max_element(lengths.begin(), lengths.end());
+    std::vector<uint32_t> count(maxBits + 2, 0), next(maxBits + 2, 0);
+    for (int l: lengths) {
+        if (l > 0) ++count[l];
+    }
+    uint32_t code = 0;
+    for (int bits = 1; bits <= maxBits; ++bits) {
+        code = (code + count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    std::vector<uint32_t> codes(lengths.size(), 0);
+    for (size_t i = 0; i < lengths.size(); ++i) {
+        if (lengths[i] > 0) codes[i] = next[lengths[i]]++;
+    }
+    return codes;
+}
+
+// Greedy LZ77 over one chunk. Candidates are the previous byte, the previous pixel and the same
+// byte one filtered row up, where flat images repeat, plus the last position with the same
+// three bytes. Matches never reach before the start of data.
+inline std::vector<Token> tokenize(const std::vector<Uint8> &data, int bpp, int stride) {
+    std::vector<Token> tokens;
+    std::vector<int32_t> head(1 << 15, -1);
+    auto hash = [&](size_t i) {
+        return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & 0x7FFF;
+    };
+
+    size_t n = data.size();
+    size_t i = 0;
+    while (i < n) {
+        int bestLength = 0, bestDistance = 0;
+        int candidates[] = {1, bpp, stride, 0};
+        if (i + 2 < n) {
+            int32_t &slot = head[hash(i)];
+            if (slot >= 0) candidates[3] = static_cast<int>(i - slot);
+            slot = static_cast<int32_t>(i);
+        }
+        for (int d: candidates) {
+            if (d <= 0 || d > 32768 || static_cast<size_t>(d) > i) continue;
+            size_t limit = std::min<size_t>(258, n - i);
+            size_t len = 0;
+            while (len < limit && data[i + len] == data[i + len - d]) ++len;
+            if (static_cast<int>(len) > bestLength) {
+                bestLength = static_cast<int>(len);
+                bestDistance = d;
+                if (len == 258) break;
+            }
+        }
+        if (bestLength >= 3) {
+            tokens.push_back({static_cast<uint16_t>(bestLength), static_cast<uint16_t>(bestDistance)});
+            i += bestLength;
+        } else {
+            tokens.push_back({0, data[i]});
+            ++i;
+        }
+    }
+    return tokens;
+}
+
+// One dynamic-Huffman block over data, followed by an empty stored block to reach a byte
+// boundary.
+inline void deflateChunk(const std::vector<Uint8> &data, int bpp, int stride, std::string &out) {
+    std::vector<Token> tokens = tokenize(data, bpp, stride);
+
+    std::vector<uint32_t> litFreq(286, 0), distFreq(30, 0);
+    for (const Token &t: tokens) {
+        if (t.length == 0) {
+            ++litFreq[t.value];
+        } else {
+            ++litFreq[257 + lengthSymbol(t.length)];
+            ++distFreq[distSymbol(t.value)];
+        }
+    }
+    litFreq[256] = 1;
+
+    std::vector<int> litLengths = codeLengths(litFreq, 15);
+    std::vector<int> distLengths = codeLengths(distFreq, 15);
+    if (*std::max_element(distLengths.begin(), distLengths.end()) == 0) distLengths[0] = 1;
+    int hlit = 286, hdist = 30;
+    while (hlit > 257 && litLengths[hlit - 1] == 0) --hlit;
+    while (hdist > 1 && distLengths[hdist - 1] == 0) --hdist;
+
+    // Code lengths of both alphabets, run-length coded with symbols 16 (repeat previous),
+    // 17 and 18 (runs of zeros).
+    std::vector<int> all(litLengths.begin(), litLengths.begin() + hlit);
+    all.insert(all.end(), distLengths.begin(), distLengths.begin() + hdist);
+    std::vector<std::pair<int, int>> runs;
+    for (size_t i = 0; i < all.size();) {
+        size_t run = 1;
+        while (i + run < all.size() && all[i + run] == all[i]) ++run;
+        if (all[i] == 0 && run >= 3) {
+            size_t take = std::min<size_t>(run, 138);
+            runs.push_back(take >= 11 ? std::make_pair(18, static_cast<int>(take - 11))
+                                      : std::make_pair(17, static_cast<int>(take - 3)));
+            i += take;
+        } else if (all[i] != 0 && run >= 4) {
+            runs.push_back({all[i], 0});
+            size_t take = std::min<size_t>(run - 1, 6);
+            runs.push_back({16, static_cast<int>(take - 3)});
+            i += take + 1;
+        } else {
+            runs.push_back({all[i], 0});
+            ++i;
+        }
+    }
+    std::vector<uint32_t> clFreq(19, 0);
+    for (const auto &r: runs) ++clFreq[r.first];
+    std::vector<int> clLengths = codeLengths(clFreq, 7);
+    std::vector<uint32_t> clCodes = canonicalCodes(clLengths);
+    static const int clOrder[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    int hclen = 19;
+    while (hclen > 4 && clLengths[clOrder[hclen - 1]] == 0) --hclen;
+
+    BitWriter bw(out);
+    bw.bits(0, 1);
+    bw.bits(2, 2);
+    bw.bits(hlit - 257, 5);
+    bw.bits(hdist - 1, 5);
+    bw.bits(hclen - 4, 4);
+    for (int i = 0; i < hclen; ++i) bw.bits(clLengths[clOrder[i]], 3);
+    for (const auto &r: runs) {
+        bw.code(clCodes[r.first], clLengths[r.first]);
+        if (r.first == 16) bw.bits(r.second, 2);
+        else if (r.first == 17) bw.bits(r.second, 3);
+        else if (r.first == 18) bw.bits(r.second, 7);
+    }
+
+    std::vector<uint32_t> litCodes = canonicalCodes(litLengths);
+    std::vector<uint32_t> distCodes = canonicalCodes(distLengths);
+    for (const Token &t: tokens) {
+        if (t.length == 0) {
+            bw.code(litCodes[t.value], litLengths[t.value]);
+            continue;
+        }
+        int l = lengthSymbol(t.length);
+        bw.code(litCodes[257 + l], litLengths[257 + l]);
+        bw.bits(t.length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+        int d = distSymbol(t.value);
+        bw.code(distCodes[d], distLengths[d]);
+        bw.bits(t.value - DIST_BASE[d], DIST_EXTRA[d]);
+    }
+    bw.code(litCodes[256], litLengths[256]);
+
+    bw.bits(0, 1);
+    bw.bits(0, 2);
+    bw.align();
+    out.append("\x00\x00\xFF\xFF", 4);
+}
+
+inline void putBigEndian(std::string &out, uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+inline std::string chunk(const char *type, const std::string &payload) {
+    std::string out;
+    putBigEndian(out, static_cast<uint32_t>(payload.size()));
+    out.append(type, 4);
+    out += payload;
+    uint32_t crc = crc32(0, reinterpret_cast<const Uint8 *>(type), 4);
+    crc = crc32(crc, reinterpret_cast<const Uint8 *>(payload.data()), payload.size());
+    putBigEndian(out, crc);
+    return out;
+}
+
+struct EncodedChunk {
+    std::string idat;
+    uint32_t adler;
+    uint64_t size;
+};
+
+// Filters each row with whichever of None, Sub and Up gives the smallest sum of absolute
+// differences, then deflates the chunk. previous is the row above the first one (zeros at the
+// top of the image).
+inline EncodedChunk encodeRows(const std::vector<Uint8> &rows, std::vector<Uint8> previous, int rowBytes,
+                               int bpp) {
+    size_t count = rows.size() / rowBytes;
+    std::vector<Uint8> filtered;
+    filtered.reserve(count * (rowBytes + 1));
+    std::vector<Uint8> sub(rowBytes), up(rowBytes);
+
+    for (size_t r = 0; r < count; ++r) {
+        const Uint8 *row = &rows[r * rowBytes];
+        long costNone = 0, costSub = 0, costUp = 0;
+        for (int i = 0; i < rowBytes; ++i) {
+            sub[i] = static_cast<Uint8>(row[i] - (i >= bpp ? row[i - bpp] : 0));
+            up[i] = static_cast<Uint8>(row[i] - previous[i]);
+            costNone += std::abs(static_cast<int8_t>(row[i]));
+            costSub += std::abs(static_cast<int8_t>(sub[i]));
+            costUp += std::abs(static_cast<int8_t>(up[i]));
+        }
+        if (costSub <= costUp && costSub <= costNone) {
+            filtered.push_back(1);
+            filtered.insert(filtered.end(), sub.begin(), sub.end());
+        } else if (costUp <= costNone) {
+            filtered.push_back(2);
+            filtered.insert(filtered.end(), up.begin(), up.end());
+        } else {
+            filtered.push_back(0);
+            filtered.insert(filtered.end(), row, row + rowBytes);
+        }
+        std::memcpy(previous.data(), row, rowBytes);
+    }
+
+    std::string deflated;
+    deflateChunk(filtered, bpp, rowBytes + 1, deflated);
+    return {chunk("IDAT", deflated), adler32(filtered.data(), filtered.size()), filtered.size()};
+}
+
+}
+
+// PNG written band by band, either RGBA or, when constructed with a palette, 8-bit indexed
+// color. At most `threads` chunks are being encoded at once; writeRows blocks on the oldest when
+// that limit is reached, so memory stays bounded and chunks are written in order. The surface
+// rows must be SDL_PIXELFORMAT_RGBA32, as the canvas creates them; indexed images are fed one
+// row of palette indices at a time through writeRow.
+class PngWriter : public RowWriter {
+public:
+    explicit PngWriter(int threads, std::vector<SDL_Color> palette = {})
+            : threads(std::max(1, threads)), palette(std::move(palette)) {}
+
+    ~PngWriter() override {
+        for (auto &f: pending) f.wait();
+    }
+
+    bool open(const std::string &path, int width, int height) override {
+        out.open(path, std::ios::binary);
+        if (!out.is_open()) return false;
+        bpp = palette.empty() ? 4 : 1;
+        rowBytes = width * bpp;
+        chunkRows = std::max(1, (1 << 20) / std::max(1, rowBytes));
+        previous.assign(rowBytes, 0);
+
+        std::string header;
+        png::putBigEndian(header, static_cast<uint32_t>(width));
+        png::putBigEndian(header, static_cast<uint32_t>(height));
+        header.append(palette.empty() ? "\x08\x06\x00\x00\x00" : "\x08\x03\x00\x00\x00", 5);
+        out.write("\x89PNG\r\n\x1a\n", 8);
+        writeChunk(png::chunk("IHDR", header));
+        if (!palette.empty()) {
+            std::string colors, alphas;
+            bool translucent = false;
+            for (const SDL_Color &c: palette) {
+                colors += {static_cast<char>(c.r), static_cast<char>(c.g), static_cast<char>(c.b)};
+                alphas.push_back(static_cast<char>(c.a));
+                translucent = translucent || c.a != 255;
+            }
+            writeChunk(png::chunk("PLTE", colors));
+            if (translucent) writeChunk(png::chunk("tRNS", alphas));
+        }
+        writeChunk(png::chunk("IDAT", std::string("\x78\x01", 2)));
+        return out.good();
+    }
+
+    bool writeRows(const SDL_Surface *surface, int rows) override {
+        for (int y = 0; y < rows; ++y) {
+            writeRow(static_cast<const Uint8 *>(surface->pixels) + static_cast<size_t>(y) * surface->pitch);
+        }
+        return out.good();
+    }
+
+    // One packed row: width RGBA pixels, or width palette indices.
+    bool writeRow(const Uint8 *row) {
+        buffer.insert(buffer.end(), row, row + rowBytes);
+        if (static_cast<int>(buffer.size() / rowBytes) == chunkRows) submit();
+        return out.good();
+    }
+
+    bool close() override {
+        if (!buffer.empty()) submit();
+        while (!pending.empty()) drainOne();
+
+        std::string tail("\x01\x00\x00\xFF\xFF", 5);
+        png::putBigEndian(tail, adler);
+        writeChunk(png::chunk("IDAT", tail));
+        writeChunk(png::chunk("IEND", ""));
+        out.close();
+        return !out.fail();
+    }
+
+private:
+    void submit() {
+        if (static_cast<int>(pending.size()) >= threads) drainOne();
+        std::vector<Uint8> rows;
+        rows.swap(buffer);
+        std::vector<Uint8> above = previous;
+        std::copy(rows.end() - rowBytes, rows.end(), previous.begin());
+        pending.push_back(std::async(std::launch::async, png::encodeRows, std::move(rows), std::move(above),
+                                     rowBytes, bpp));
+    }
+
+    void drainOne() {
+        png::EncodedChunk encoded = pending.front().get();
+        pending.pop_front();
+        adler = png::adler32Combine(adler, encoded.adler, encoded.size);
+        writeChunk(encoded.idat);
+    }
+
+    void writeChunk(const std::string &bytes) {
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    std::ofstream out;
+    int threads;
+    std::vector<SDL_Color> palette;
+    int bpp = 4;
+    int rowBytes = 0;
+    int chunkRows = 1;
+    std::vector<Uint8> buffer;
+    std::vector<Uint8> previous;
+    std::deque<std::future<png::EncodedChunk>> pending;
+    uint32_t adler = 1;
+};
+
+// Whole-surface convenience wrapper used in place of IMG_SavePNG.
+bool savePng(const SDL_Surface *surface, const std::string &path, int threads) {
+    PROFILE_STAGE("png");
+    PngWriter writer(threads);
+    return writer.open(path, surface->w, surface->h) && writer.writeRows(surface, surface->h) && writer.close();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <SDL.h>
+
+const int WIDTH = 1000;
+const int HEIGHT = 1000;
+const int SPOT_RADIUS = 5;
+const float NO_SITE_DIST = 1e9;
+
+// weight is only read by the weighted metrics (PowerMetric, AdditiveMetric); it is a length in
+// the same units as x and y.
+struct Point {
+    double x, y;
+    SDL_Color color;
+    double weight = 0;
+};
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "point.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary site file: a fixed header followed by count float32 xs, count float32 ys, then count
+// packed RGBA colors when POINT_FILE_COLORS is set and count float32 weights when
+// POINT_FILE_WEIGHTS is set. All arrays start on 16-byte offsets. Version 1 files may only set
+// POINT_FILE_COLORS; files with weights are written as version 2, so version 1 readers, which
+// check the version but not the flags, refuse them instead of ignoring the weights. Readers
+// reject any flag bit their version does not define.
+const uint32_t POINT_FILE_MAGIC = 0x53545056; // "VPTS" little-endian
+const uint32_t POINT_FILE_VERSION = 2;
+const uint32_t POINT_FILE_COLORS = 1;
+const uint32_t POINT_FILE_WEIGHTS = 2;
+
+// Flags a file of the given version may carry.
+inline uint32_t pointFileKnownFlags(uint32_t version) {
+    return version >= 2 ? (POINT_FILE_COLORS | POINT_FILE_WEIGHTS) : POINT_FILE_COLORS;
+}
+
+struct PointFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint32_t flags;
+    float minX, minY, maxX, maxY;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(PointFileHeader) == 40, "PointFileHeader must stay packed to 40 bytes");
+
+inline uint64_t pointFileAlign(uint64_t offset) {
+    return (offset + 15) & ~uint64_t(15);
+}
+
+inline uint64_t pointFileXsOffset() {
+    return pointFileAlign(sizeof(PointFileHeader));
+}
+
+inline uint64_t pointFileYsOffset(uint64_t count) {
+    return pointFileAlign(pointFileXsOffset() + count * sizeof(float));
+}
+
+inline uint64_t pointFileColorsOffset(uint64_t count) {
+    return pointFileAlign(pointFileYsOffset(count) + count * sizeof(float));
+}
+
+inline uint64_t pointFileWeightsOffset(uint64_t count, bool colors) {
+    return colors ? pointFileAlign(pointFileColorsOffset(count) + count * sizeof(uint32_t))
+                  : pointFileColorsOffset(count);
+}
+
+inline uint64_t pointFileSize(uint64_t count, bool colors, bool weights) {
+    if (weights) return pointFileWeightsOffset(count, colors) + count * sizeof(float);
+    return colors ? pointFileColorsOffset(count) + count * sizeof(uint32_t)
+                  : pointFileYsOffset(count) + count * sizeof(float);
+}
+
+// Read-only mapping of a whole file; the view stays valid for the lifetime of the object.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return;
+        data = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data) bytes = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || st.st_size == 0) return;
+        void *view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) return;
+        data = static_cast<const unsigned char *>(view);
+        bytes = static_cast<uint64_t>(st.st_size);
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap(const_cast<unsigned char *>(data), bytes);
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const {
+        return data != nullptr;
+    }
+
+    const unsigned char *begin() const {
+        return data;
+    }
+
+    uint64_t size() const {
+        return bytes;
+    }
+
+private:
+    const unsigned char *data = nullptr;
+    uint64_t bytes = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Typed view into a mapped point file; pointers alias the mapping and need no copy.
+struct PointFileView {
+    const PointFileHeader *header = nullptr;
+    const float *xs = nullptr;
+    const float *ys = nullptr;
+    const uint32_t *colors = nullptr;
+    const float *weights = nullptr;
+};
+
+// Validates the header and array bounds against the mapping size.
+bool viewPointFile(const MappedFile &file, PointFileView &view, std::string &error) {
+    if (file.size() < sizeof(PointFileHeader)) {
+        error = "file is shorter than the header";
+        return false;
+    }
+    const auto *header = reinterpret_cast<const PointFileHeader *>(file.begin());
+    if (header->magic != POINT_FILE_MAGIC) {
+        error = "bad magic number";
+        return false;
+    }
+    if (header->version < 1 || header->version > POINT_FILE_VERSION) {
+        error = "unsupported version " + std::to_string(header->version);
+        return false;
+    }
+    if ((header->flags & ~pointFileKnownFlags(header->version)) != 0) {
+        error = "unknown flags " + std::to_string(header->flags) + " for version " + std::to_string(header->version);
+        return false;
+    }
+    bool colors = (header->flags & POINT_FILE_COLORS) != 0;
+    bool weights = (header->flags & POINT_FILE_WEIGHTS) != 0;
+    if (header->count > (file.size() / sizeof(float)) ||
+        file.size() < pointFileSize(header->count, colors, weights)) {
+        error = "file is truncated";
+        return false;
+    }
+
+    view.header = header;
+    view.xs = reinterpret_cast<const float *>(file.begin() + pointFileXsOffset());
+    view.ys = reinterpret_cast<const float *>(file.begin() + pointFileYsOffset(header->count));
+    view.colors = colors ? reinterpret_cast<const uint32_t *>(file.begin() + pointFileColorsOffset(header->count))
+                         : nullptr;
+    view.weights = weights ? reinterpret_cast<const float *>(file.begin() +
+                                                             pointFileWeightsOffset(header->count, colors))
+                           : nullptr;
+    return true;
+}
+
+bool isPointFile(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    uint32_t magic = 0;
+    in.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    return in.gcount() == sizeof(magic) && magic == POINT_FILE_MAGIC;
+}
+
+// Maps the file and expands it into points. Colors are copied when present and left opaque
+// black otherwise, mirroring what the JSON loader produces; missing weights are 0.
+bool readPointFile(const std::string &path, std::vector<Point> &points, bool &hasColors, std::string &error) {
+    MappedFile file(path);
+    if (!file.isOpen()) {
+        error = "cannot map file";
+        return false;
+    }
+    PointFileView view;
+    if (!viewPointFile(file, view, error)) return false;
+
+    hasColors = view.colors != nullptr;
+    points.resize(view.header->count);
+    for (uint64_t i = 0; i < view.header->count; ++i) {
+        Point &p = points[i];
+        p.x = view.xs[i];
+        p.y = view.ys[i];
+        p.weight = view.weights ? view.weights[i] : 0.0;
+        if (hasColors) {
+            uint32_t c = view.colors[i];
+            p.color = {Uint8(c & 0xFF), Uint8((c >> 8) & 0xFF), Uint8((c >> 16) & 0xFF), Uint8(c >> 24)};
+        } else {
+            p.color = {0, 0, 0, 255};
+        }
+    }
+    return true;
+}
+
+// Weights are stored only when some point has a non-zero one.
+bool writePointFile(const std::string &path, const std::vector<Point> &points, bool withColors) {
+    bool withWeights = std::any_of(points.begin(), points.end(), [](const Point &p) { return p.weight != 0; });
+    PointFileHeader header{};
+    header.magic = POINT_FILE_MAGIC;
+    header.version = withWeights ? 2 : 1;
+    header.count = points.size();
+    header.flags = (withColors ? POINT_FILE_COLORS : 0) | (withWeights ? POINT_FILE_WEIGHTS : 0);
+    if (!points.empty()) {
+        header.minX = header.maxX = float(points[0].x);
+        header.minY = header.maxY = float(points[0].y);
+    }
+
+    std::vector<float> xs(points.size()), ys(points.size());
+    std::vector<uint32_t> colors(withColors ? points.size() : 0);
+    std::vector<float> weights(withWeights ? points.size() : 0);
+    for (size_t i = 0; i < points.size(); ++i) {
+        xs[i] = float(points[i].x);
+        ys[i] = float(points[i].y);
+        header.minX = std::min(header.minX, xs[i]);
+        header.minY = std::min(header.minY, ys[i]);
+        header.maxX = std::max(header.maxX, xs[i]);
+        header.maxY = std::max(header.maxY, ys[i]);
+        if (withColors) {
+            const SDL_Color &c = points[i].color;
+            colors[i] = uint32_t(c.r) | uint32_t(c.g) << 8 | uint32_t(c.b) << 16 | uint32_t(c.a) << 24;
+        }
+        if (withWeights) weights[i] = float(points[i].weight);
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) return false;
+    auto padTo = [&out](uint64_t offset) {
+        static const char zeros[16] = {};
+        uint64_t at = static_cast<uint64_t>(out.tellp());
+        out.write(zeros, static_cast<std::streamsize>(offset - at));
+    };
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    padTo(pointFileXsOffset());
+    out.write(reinterpret_cast<const char *>(xs.data()), static_cast<std::streamsize>(xs.size() * sizeof(float)));
+    padTo(pointFileYsOffset(header.count));
+    out.write(reinterpret_cast<const char *>(ys.data()), static_cast<std::streamsize>(ys.size() * sizeof(float)));
+    if (withColors) {
+        padTo(pointFileColorsOffset(header.count));
+        out.write(reinterpret_cast<const char *>(colors.data()),
+                  static_cast<std::streamsize>(colors.size() * sizeof(uint32_t)));
+    }
+    if (withWeights) {
+        padTo(pointFileWeightsOffset(header.count, withColors));
+        out.write(reinterpret_cast<const char *>(weights.data()),
+                  static_cast<std::streamsize>(weights.size() * sizeof(float)));
+    }
+    return out.good();
+}
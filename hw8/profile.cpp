@@ -0,0 +1,64 @@
+// Counting replacements for the global allocation functions, linked into profiled builds only
+// (see profile.h). The array and nothrow forms forward to these. Keeping them out of the header
+// gives the program one definition however many files include it, and keeps the compiler from
+// pairing an inlined free() with a call to operator new.
+#ifdef VORONOI_PROFILE
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include "profile.h"
+
+namespace {
+
+void countAllocation(std::size_t size) {
+    profile::allocations.fetch_add(1, std::memory_order_relaxed);
+    profile::allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+}
+
+void *operator new(std::size_t size) {
+    countAllocation(size);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    countAllocation(size);
+    std::size_t align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants a size that is a multiple of the alignment.
+    std::size_t padded = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+#ifdef _WIN32
+    void *p = _aligned_malloc(padded, align);
+#else
+    void *p = std::aligned_alloc(align, padded);
+#endif
+    if (p) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
+
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <string>
+
+// Per-stage instrumentation, compiled in with -DVORONOI_PROFILE and absent otherwise: without
+// the define the macros below expand to nothing, so the hot loops carry no counters at all.
+//
+// PROFILE_STAGE("name") times the rest of the enclosing scope and adds, to that stage's totals,
+// the wall time, the operator new calls and bytes, and the distance evaluations made during it
+// on any thread. Stages nest and their totals are inclusive, so "raster" counts the grid built
+// inside it. PROFILE_DISTANCES(n) counts n key evaluations into a plain thread-local counter;
+// forEachTileOnWorkers folds a worker's count into the shared total after each tile, so the
+// render loops never touch a contended cache line. profile::report prints the table and, given
+// a path, writes the same numbers as JSON.
+//
+// The allocation counts come from replacing the global operator new and delete, which must be
+// defined exactly once in the program, so they live in profile.cpp. A profiled build links it:
+//   g++ -std=c++17 -O2 -DVORONOI_PROFILE main.cpp profile.cpp ...
+#ifdef VORONOI_PROFILE
+
+#include <SDL.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace profile {
+
+struct StageTotals {
+    std::string name;
+    uint64_t calls = 0;
+    double ms = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t distances = 0;
+};
+
+inline thread_local uint64_t localDistances = 0;
+inline std::atomic<uint64_t> distances{0};
+inline std::atomic<uint64_t> allocations{0};
+inline std::atomic<uint64_t> allocatedBytes{0};
+inline std::mutex stagesLock;
+inline std::vector<StageTotals> stages;  // in the order they first ran
+
+// Adds this thread's distance count to the shared total.
+inline void flushThread() {
+    distances.fetch_add(localDistances, std::memory_order_relaxed);
+    localDistances = 0;
+}
+
+class Stage {
+public:
+    explicit Stage(const char *name) : name(name) {
+        flushThread();
+        startDistances = distances.load(std::memory_order_relaxed);
+        startAllocations = allocations.load(std::memory_order_relaxed);
+        startBytes = allocatedBytes.load(std::memory_order_relaxed);
+        start = SDL_GetPerformanceCounter();
+    }
+
+    Stage(const Stage &) = delete;
+    Stage &operator=(const Stage &) = delete;
+
+    ~Stage() {
+        double ms = 1000.0 * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+        flushThread();
+        uint64_t evaluated = distances.load(std::memory_order_relaxed) - startDistances;
+        uint64_t allocated = allocations.load(std::memory_order_relaxed) - startAllocations;
+        uint64_t bytes = allocatedBytes.load(std::memory_order_relaxed) - startBytes;
+
+        std::lock_guard<std::mutex> guard(stagesLock);
+        StageTotals *totals = nullptr;
+        for (auto &s: stages) {
+            if (s.name == name) totals = &s;
+        }
+        if (!totals) {
+            stages.push_back({name});
+            totals = &stages.back();
+        }
+        ++totals->calls;
+        totals->ms += ms;
+        totals->allocations += allocated;
+        totals->allocatedBytes += bytes;
+        totals->distances += evaluated;
+    }
+
+private:
+    const char *name;
+    Uint64 start;
+    uint64_t startDistances, startAllocations, startBytes;
+};
+
+inline bool report(const std::string &jsonPath) {
+    std::lock_guard<std::mutex> guard(stagesLock);
+    std::printf("%-16s %8s %12s %12s %12s %16s\n", "stage", "calls", "ms", "allocs", "MB", "distances");
+    for (const auto &s: stages) {
+        std::printf("%-16s %8llu %12.2f %12llu %12.2f %16llu\n", s.name.c_str(),
+                    static_cast<unsigned long long>(s.calls), s.ms, static_cast<unsigned long long>(s.allocations),
+                    s.allocatedBytes / 1048576.0, static_cast<unsigned long long>(s.distances));
+    }
+    std::fflush(stdout);
+    if (jsonPath.empty()) return true;
+
+    std::ofstream out(jsonPath);
+    out << "{\"stages\": [";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const StageTotals &s = stages[i];
+        out << (i ? ",\n  " : "\n  ") << "{\"name\": \"" << s.name << "\", \"calls\": " << s.calls
+            << ", \"ms\": " << s.ms << ", \"allocations\": " << s.allocations
+            << ", \"allocated_bytes\": " << s.allocatedBytes << ", \"distance_evaluations\": " << s.distances << "}";
+    }
+    out << "\n]}\n";
+    if (!out.good()) {
+        std::cerr << "Failed to write " << jsonPath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+#define PROFILE_JOIN_(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_(a, b)
+#define PROFILE_STAGE(name) profile::Stage PROFILE_JOIN(profileStage, __LINE__)(name)
+#define PROFILE_DISTANCES(n) (profile::localDistances += (n))
+#define PROFILE_FLUSH() profile::flushThread()
+
+#else
+
+#include <iostream>
+
+namespace profile {
+
+inline bool report(const std::string &jsonPath) {
+    if (!jsonPath.empty()) {
+        std::cerr << "Built without VORONOI_PROFILE, no report for " << jsonPath << std::endl;
+    }
+    return true;
+}
+
+}
+
+#define PROFILE_STAGE(name)
+#define PROFILE_DISTANCES(n)
+#define PROFILE_FLUSH()
+
+#endif
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+#include "grid.h"
+#include "tiles.h"
+
+// Whether four corners owned by one site prove that the whole block between them is, with ties
+// going to the lowest index as in every exact search. Site s beats t at p when
+// f(p) = key_t(p) - key_s(p) is positive (or zero and s < t), so it is enough that f is never
+// smaller inside a block than at all of its corners:
+//   - Euclidean and power: the key is d^2 - w^2 up to a monotone map, so f is affine and its
+//     minimum over a block is at a corner. This is the convexity of their cells.
+//   - Manhattan: f = (|x - tx| - |x - sx|) + (|y - ty| - |y - sy|) is a sum of a monotone
+//     function of x and one of y, so its minimum is again at a corner.
+// Chebyshev has no such split. Where two sites share a row or column, whole quadrants are
+// equidistant and go to the lower index: with sites 0 at (0, 0) and 1 at (2, 0) the corners of
+// [-5, 5]^2 all belong to 0 while (5, 0), and site 1 itself, belong to 1. The Lp and weighted
+// metrics curve their bisectors the same way, so those need blockInCell's second test.
+template<class M>
+constexpr bool cornersDecideBlocks() {
+    return std::is_same_v<M, EuclideanMetric> || std::is_same_v<M, PowerMetric> ||
+           std::is_same_v<M, ManhattanMetric>;
+}
+
+// Metrics the quadtree can prove blocks for; Minkowski exponents below 1 have no triangle
+// inequality for blockInCell to lean on.
+template<class M>
+bool quadtreeSupports(const M &metric = M()) {
+    if constexpr (std::is_same_v<M, MinkowskiMetric>) {
+        return metric.exponent >= 1;
+    } else {
+        return true;
+    }
+}
+
+// Recursive subdivision of one tile. A block whose four corner pixels have the same owner and
+// provably lies in its cell is filled without searching its interior; any other block is split
+// in four, sharing the corner labels already found, down to blocks at most two pixels across
+// whose pixels are all searched.
+template<class M, class L>
+class BlockFiller {
+public:
+    // labels holds rows from image row firstRow on; tiles are in label rows.
+    BlockFiller(const SiteGrid &grid, L *labels, int width, int firstRow, const M &metric)
+            : grid(grid), labels(labels), width(width), firstRow(firstRow), metric(metric) {}
+
+    void fillTile(const Tile &tile) {
+        int x0 = tile.x0, y0 = tile.y0, x1 = tile.x1 - 1, y1 = tile.y1 - 1;
+        block(x0, y0, x1, y1, search(x0, y0), search(x1, y0), search(x0, y1), search(x1, y1));
+    }
+
+    // Nearest-site searches run so far, the block proofs included.
+    size_t searches = 0;
+
+private:
+    const SiteGrid &grid;
+    L *labels;
+    int width;
+    int firstRow;
+    M metric;
+
+    int search(int x, int y) {
+        ++searches;
+        return grid.nearest(static_cast<float>(x), static_cast<float>(firstRow + y), metric);
+    }
+
+    void set(int x, int y, int site) {
+        labels[static_cast<size_t>(y) * width + x] = static_cast<L>(site);
+    }
+
+    // Inclusive pixel block [x0, x1] x [y0, y1] with the owners of its corners.
+    void block(int x0, int y0, int x1, int y1, int c00, int c10, int c01, int c11) {
+        if (x1 - x0 < 2 || y1 - y0 < 2) {
+            for (int y = y0; y <= y1; ++y) {
+                for (int x = x0; x <= x1; ++x) {
+                    bool left = x == x0, top = y == y0;
+                    bool corner = (left || x == x1) && (top || y == y1);
+                    set(x, y, corner ? (top ? (left ? c00 : c10) : (left ? c01 : c11)) : search(x, y));
+                }
+            }
+            return;
+        }
+        if (c00 == c10 && c00 == c01 && c00 == c11 && blockInCell(c00, x0, y0, x1, y1)) {
+            for (int y = y0; y <= y1; ++y) {
+                std::fill(labels + static_cast<size_t>(y) * width + x0,
+                          labels + static_cast<size_t>(y) * width + x1 + 1, static_cast<L>(c00));
+            }
+            return;
+        }
+
+        int xm = (x0 + x1) / 2, ym = (y0 + y1) / 2;
+        int top = search(xm, y0), left = search(x0, ym), mid = search(xm, ym);
+        int right = search(x1, ym), bottom = search(xm, y1);
+        block(x0, y0, xm, ym, c00, top, left, mid);
+        block(xm, y0, x1, ym, top, c10, mid, right);
+        block(x0, ym, xm, y1, left, mid, c01, bottom);
+        block(xm, ym, x1, y1, mid, right, bottom, c11);
+    }
+
+    // Corners that agree settle it where cornersDecideBlocks says so. Otherwise the block's
+    // centre must be owned by site with every other site more than twice the centre-to-corner
+    // distance r farther away: a pixel within r of the centre is then, by the triangle
+    // inequality, at most nearest + r from site and more than nearest + r from the rest. The
+    // weighted keys are distances less a per-site constant, which the argument carries over.
+    bool blockInCell(int site, int x0, int y0, int x1, int y1) {
+        if constexpr (cornersDecideBlocks<M>()) {
+            return true;
+        } else {
+            float halfW = 0.5f * (x1 - x0), halfH = 0.5f * (y1 - y0);
+            float bestKey, secondKey;
+            ++searches;
+            if (grid.nearestTwo(x0 + halfW, firstRow + y0 + halfH, bestKey, secondKey, metric) != site) return false;
+            float reach = M::distance(siteKey(halfW, halfH, 0, metric));
+            float nearest = M::distance(bestKey);
+            float runnerUp = M::distance(secondKey);
+            return runnerUp - nearest - 1e-4f * (1.0f + std::abs(runnerUp)) > 2 * reach;
+        }
+    }
+};
+
+// Exact labels from quadtree block fill over each tile (see BlockFiller). Large cells cost a
+// few searches per block instead of one per pixel, so the work follows the length of the cell
+// borders. When verbose, reports how many searches that took next to one per pixel.
+template<class M, class L = int>
+std::vector<L> quadtreeLabels(const std::vector<Point> &points, int width, int height, int threads,
+                              int firstRow = 0, bool verbose = false, const M &metric = M()) {
+    std::vector<L> labels(static_cast<size_t>(width) * height);
+    SiteGrid grid;
+    grid.build(points);
+    std::vector<size_t> searches(std::max(1, threads), 0);
+
+    forEachTileOnWorkers(width, height, threads, [&](const Tile &tile, int worker) {
+        BlockFiller<M, L> filler(grid, labels.data(), width, firstRow, metric);
+        filler.fillTile(tile);
+        searches[worker] += filler.searches;
+    });
+
+    if (!verbose) return labels;
+    size_t total = 0;
+    for (size_t count: searches) total += count;
+    std::cout << "Quadtree ran " << total << " searches for " << labels.size() << " pixels ("
+              << 100.0 * total / std::max<size_t>(1, labels.size()) << "%)...\n";
+    return labels;
+}
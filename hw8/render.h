@@ -0,0 +1,433 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "fortune.h"
+#include "grid.h"
+#include "jfa.h"
+#include "profile.h"
+#include "quadtree.h"
+#include "scanline.h"
+#include "simd.h"
+#include "tiles.h"
+
+enum class SearchMode {
+    BRUTE_FORCE,
+    GRID,
+    SIMD,
+    SCANLINE,
+    FORTUNE,
+    JUMP_FLOOD,
+    JUMP_FLOOD_CHECK,
+    QUADTREE
+};
+
+enum class MetricKind {
+    EUCLIDEAN,
+    MANHATTAN,
+    CHEBYSHEV,
+    MINKOWSKI,
+    POWER,
+    ADDITIVE
+};
+
+// World-to-pixel mapping: pixel = (world - origin) / scale. The default maps world units
+// straight onto pixels. The scale is the same on both axes, since stretching one axis would
+// change which site is nearest.
+struct View {
+    double originX = 0, originY = 0;
+    double scale = 1;
+};
+
+struct RenderOptions {
+    SearchMode mode = SearchMode::GRID;
+    int threads = defaultThreadCount();
+    int width = WIDTH;
+    int height = HEIGHT;
+    View view;
+    int antialias = 0;  // samples per axis for border pixels (see antialiasBorders), 0 for none
+    int firstRow = 0;   // image row of the labels' first row; height rows from there are rendered
+    bool verbose = true;  // report kernel choices, fallbacks and search counts on stdout
+    double lpExponent = 3;  // p of MinkowskiMetric (see metricFor)
+};
+
+// The policy value a render with these options searches with; only MinkowskiMetric has state.
+template<class M>
+M metricFor(const RenderOptions &options) {
+    if constexpr (std::is_same_v<M, MinkowskiMetric>) {
+        return MinkowskiMetric(static_cast<float>(options.lpExponent));
+    } else {
+        return M();
+    }
+}
+
+// View that fits the world rectangle [minX, maxX] x [minY, maxY] into the image, centred along
+// the axis with room to spare.
+View windowView(double minX, double minY, double maxX, double maxY, int width, int height) {
+    View view;
+    view.scale = std::max(std::max((maxX - minX) / width, (maxY - minY) / height), 1e-12);
+    view.originX = (minX + maxX) / 2 - view.scale * width / 2;
+    view.originY = (minY + maxY) / 2 - view.scale * height / 2;
+    return view;
+}
+
+// View around the bounding box of the points with a margin of one spot radius on each side.
+View fitView(const std::vector<Point> &points, int width, int height) {
+    if (points.empty()) return {};
+    double minX = points[0].x, maxX = points[0].x;
+    double minY = points[0].y, maxY = points[0].y;
+    for (const auto &p: points) {
+        minX = std::min(minX, p.x);
+        minY = std::min(minY, p.y);
+        maxX = std::max(maxX, p.x);
+        maxY = std::max(maxY, p.y);
+    }
+    double margin = SPOT_RADIUS * std::max((maxX - minX) / width, (maxY - minY) / height);
+    return windowView(minX - margin, minY - margin, maxX + margin, maxY + margin, width, height);
+}
+
+// Sites moved into pixel space. Every label builder works in pixel coordinates, so this is all a
+// view needs. Weights are lengths and scale with the positions.
+std::vector<Point> toPixelSpace(const std::vector<Point> &points, const View &view) {
+    std::vector<Point> pixels(points);
+    for (auto &p: pixels) {
+        p.x = (p.x - view.originX) / view.scale;
+        p.y = (p.y - view.originY) / view.scale;
+        p.weight /= view.scale;
+    }
+    return pixels;
+}
+
+const char *metricName(MetricKind metric) {
+    switch (metric) {
+        case MetricKind::EUCLIDEAN:
+            return "euclidean";
+        case MetricKind::MANHATTAN:
+            return "manhattan";
+        case MetricKind::CHEBYSHEV:
+            return "chebyshev";
+        case MetricKind::MINKOWSKI:
+            return "minkowski";
+        case MetricKind::POWER:
+            return "power";
+        case MetricKind::ADDITIVE:
+            return "additive";
+    }
+    return "unknown";
+}
+
+bool parseMetric(const std::string &name, MetricKind &metric) {
+    for (MetricKind m: {MetricKind::EUCLIDEAN, MetricKind::MANHATTAN, MetricKind::CHEBYSHEV,
+                        MetricKind::MINKOWSKI, MetricKind::POWER, MetricKind::ADDITIVE}) {
+        if (name == metricName(m)) {
+            metric = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Calls f with a value of the policy for the Lp metric of exponent p and returns its result.
+// p = 1, 2 and infinity get their dedicated policies, whole p up to 8 the multiply-only
+// LpMetric<P>, and anything else MinkowskiMetric for p. Renders take the exponent from
+// RenderOptions::lpExponent, which must then be p as well.
+template<class F>
+auto withLpMetric(double p, F &&f) {
+    if (std::isinf(p)) return f(ChebyshevMetric{});
+    if (p == 1) return f(ManhattanMetric{});
+    if (p == 2) return f(EuclideanMetric{});
+    if (p == 3) return f(LpMetric<3>{});
+    if (p == 4) return f(LpMetric<4>{});
+    if (p == 5) return f(LpMetric<5>{});
+    if (p == 6) return f(LpMetric<6>{});
+    if (p == 7) return f(LpMetric<7>{});
+    if (p == 8) return f(LpMetric<8>{});
+    return f(MinkowskiMetric(static_cast<float>(p)));
+}
+
+// Calls f with a value of the policy for metric, p being the Lp exponent of MINKOWSKI.
+template<class F>
+auto withMetric(MetricKind metric, double p, F &&f) {
+    switch (metric) {
+        case MetricKind::MANHATTAN:
+            return f(ManhattanMetric{});
+        case MetricKind::CHEBYSHEV:
+            return f(ChebyshevMetric{});
+        case MetricKind::MINKOWSKI:
+            return withLpMetric(p, f);
+        case MetricKind::POWER:
+            return f(PowerMetric{});
+        case MetricKind::ADDITIVE:
+            return f(AdditiveMetric{});
+        default:
+            return f(EuclideanMetric{});
+    }
+}
+
+const char *searchModeName(SearchMode mode) {
+    switch (mode) {
+        case SearchMode::BRUTE_FORCE:
+            return "brute force";
+        case SearchMode::GRID:
+            return "grid";
+        case SearchMode::SIMD:
+            return "SIMD brute force";
+        case SearchMode::SCANLINE:
+            return "scanline coherent";
+        case SearchMode::FORTUNE:
+            return "Fortune sweep (Euclidean)";
+        case SearchMode::JUMP_FLOOD:
+            return "jump flooding";
+        case SearchMode::JUMP_FLOOD_CHECK:
+            return "jump flooding + error check";
+        case SearchMode::QUADTREE:
+            return "quadtree block fill";
+    }
+    return "unknown";
+}
+
+// Short names used on the command line and in job files.
+bool parseSearchMode(const std::string &name, SearchMode &mode) {
+    static const std::pair<const char *, SearchMode> names[] = {
+            {"brute",     SearchMode::BRUTE_FORCE},
+            {"grid",      SearchMode::GRID},
+            {"simd",      SearchMode::SIMD},
+            {"scanline",  SearchMode::SCANLINE},
+            {"fortune",   SearchMode::FORTUNE},
+            {"jfa",       SearchMode::JUMP_FLOOD},
+            {"jfa-check", SearchMode::JUMP_FLOOD_CHECK},
+            {"quadtree",  SearchMode::QUADTREE}
+    };
+    for (const auto &entry: names) {
+        if (name == entry.first) {
+            mode = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+SearchMode nextSearchMode(SearchMode mode) {
+    switch (mode) {
+        case SearchMode::BRUTE_FORCE:
+            return SearchMode::GRID;
+        case SearchMode::GRID:
+            return SearchMode::SIMD;
+        case SearchMode::SIMD:
+            return SearchMode::SCANLINE;
+        case SearchMode::SCANLINE:
+            return SearchMode::FORTUNE;
+        case SearchMode::FORTUNE:
+            return SearchMode::JUMP_FLOOD;
+        case SearchMode::JUMP_FLOOD:
+            return SearchMode::JUMP_FLOOD_CHECK;
+        case SearchMode::JUMP_FLOOD_CHECK:
+            return SearchMode::QUADTREE;
+        default:
+            return SearchMode::BRUTE_FORCE;
+    }
+}
+
+// Every label builder is generic over the label type L. int is the general case; when the site
+// count allows, Uint8 or Uint16 labels quarter or halve the buffer the renderer writes. "No site"
+// is -1 converted to L, which for the narrow types is their largest value, so that value is
+// never a site index (see labelTypeFits).
+template<class L>
+bool labelTypeFits(size_t siteCount) {
+    return siteCount < static_cast<size_t>(std::numeric_limits<L>::max());
+}
+
+template<class M, class L = int>
+std::vector<L> exactLabels(const std::vector<Point> &points, int width, int height, bool useGrid, int threads,
+                           int firstRow = 0, const M &metric = M()) {
+    std::vector<L> labels(static_cast<size_t>(width) * height);
+    SiteGrid grid;
+    SiteBuffer sites(points);
+    if (useGrid) {
+        grid.build(points);
+    }
+
+    forEachTile(width, height, threads, [&](const Tile &tile) {
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x = tile.x0; x < tile.x1; ++x) {
+                float px = static_cast<float>(x);
+                float py = static_cast<float>(firstRow + y);
+                labels[static_cast<size_t>(y) * width + x] = static_cast<L>(
+                        useGrid ? grid.nearest(px, py, metric) : nearestSiteScalar(sites, px, py, metric));
+            }
+        }
+    });
+    return labels;
+}
+
+template<class M, class L = int>
+std::vector<L> simdLabels(const std::vector<Point> &points, int width, int height, int threads, int firstRow = 0,
+                          bool verbose = false, const M &metric = M()) {
+    std::vector<L> labels(static_cast<size_t>(width) * height);
+    SiteBuffer sites(points);
+    const char *kernelName;
+    SimdKernel<M> kernel = selectSimdKernel<M>(&kernelName);
+    if (verbose) std::cout << "Using " << kernelName << " distance kernel...\n";
+
+    forEachTile(width, height, threads, [&](const Tile &tile) {
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x = tile.x0; x < tile.x1; ++x) {
+                labels[static_cast<size_t>(y) * width + x] = static_cast<L>(
+                        kernel(sites, static_cast<float>(x), static_cast<float>(firstRow + y), metric));
+            }
+        }
+    });
+    return labels;
+}
+
+template<class M, class L = int>
+std::vector<L> scanlineLabels(const std::vector<Point> &points, int width, int height, int threads,
+                              int firstRow = 0, const M &metric = M()) {
+    std::vector<L> labels(static_cast<size_t>(width) * height);
+    SortedSites sites(points);
+
+    forEachTile(width, height, threads, [&](const Tile &tile) {
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            scanlineRow(sites, firstRow + y, tile.x0, tile.x1, &labels[static_cast<size_t>(y) * width + tile.x0],
+                        metric);
+        }
+    });
+    return labels;
+}
+
+template<class M, class L = int>
+std::vector<L> computeLabels(const std::vector<Point> &points, const RenderOptions &options) {
+    PROFILE_STAGE("raster");
+    SearchMode mode = options.mode;
+    int width = options.width;
+    int height = options.height;
+    int firstRow = options.firstRow;
+    const M metric = metricFor<M>(options);
+    if (mode == SearchMode::SIMD) {
+        if constexpr (!M::WEIGHTED) {
+            return simdLabels<M, L>(points, width, height, options.threads, firstRow, options.verbose, metric);
+        }
+        if (options.verbose) std::cout << "Weighted metrics have no vector kernels, using the grid instead...\n";
+        mode = SearchMode::GRID;
+    }
+    if (mode == SearchMode::SCANLINE) {
+        return scanlineLabels<M, L>(points, width, height, options.threads, firstRow, metric);
+    }
+    if (mode == SearchMode::FORTUNE) {
+        if constexpr (std::is_same_v<M, EuclideanMetric>) {
+            std::vector<L> labels;
+            rasterizeCells(voronoiCells(points, -1, firstRow - 1, width, firstRow + height), width, height, labels,
+                           firstRow);
+            return labels;
+        }
+        if (options.verbose) std::cout << "Fortune sweep only builds Euclidean cells, using the grid instead...\n";
+        mode = SearchMode::GRID;
+    }
+    if (mode == SearchMode::QUADTREE) {
+        if (quadtreeSupports(metric)) {
+            return quadtreeLabels<M, L>(points, width, height, options.threads, firstRow, options.verbose, metric);
+        }
+        if (options.verbose) std::cout << "Quadtree blocks need a triangle inequality, using the grid instead...\n";
+        mode = SearchMode::GRID;
+    }
+    if (mode == SearchMode::BRUTE_FORCE || mode == SearchMode::GRID) {
+        return exactLabels<M, L>(points, width, height, mode == SearchMode::GRID, options.threads, firstRow, metric);
+    }
+
+    // Jump flooding keeps int labels while it runs; they are narrowed once at the end.
+    std::vector<int> flooded = jumpFlood(points, width, height, options.threads, metric);
+    std::vector<L> labels(flooded.begin(), flooded.end());
+    if (mode == SearchMode::JUMP_FLOOD_CHECK) {
+        if (options.verbose) std::cout << "Checking against exact result...\n";
+        std::vector<L> exact = exactLabels<M, L>(points, width, height, true, options.threads, firstRow, metric);
+        size_t wrong = 0;
+        for (size_t i = 0; i < labels.size(); ++i) {
+            if (labels[i] != exact[i]) ++wrong;
+        }
+        std::cout << wrong << " of " << labels.size() << " pixels differ ("
+                  << 100.0 * wrong / labels.size() << "%)\n";
+    }
+    return labels;
+}
+
+// Labels for several metrics from one pass over the image. In grid mode the sites are indexed
+// once and every pixel runs a single ring search for all metrics; the other modes have no shared
+// traversal and compute each metric in turn.
+template<class L, class... Ms>
+std::array<std::vector<L>, sizeof...(Ms)> computeLabelsEach(const std::vector<Point> &points,
+                                                            const RenderOptions &options) {
+    if (options.mode != SearchMode::GRID) {
+        return {computeLabels<Ms, L>(points, options)...};
+    }
+    PROFILE_STAGE("raster");
+
+    constexpr size_t count = sizeof...(Ms);
+    int width = options.width;
+    int height = options.height;
+    std::array<std::vector<L>, count> labels;
+    for (auto &l: labels) {
+        l.resize(static_cast<size_t>(width) * height);
+    }
+    SiteGrid grid;
+    grid.build(points);
+
+    forEachTile(width, height, options.threads, [&](const Tile &tile) {
+        int best[count];
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x = tile.x0; x < tile.x1; ++x) {
+                grid.nearestEach<Ms...>(static_cast<float>(x), static_cast<float>(options.firstRow + y), best);
+                size_t i = static_cast<size_t>(y) * width + x;
+                for (size_t m = 0; m < count; ++m) {
+                    labels[m][i] = static_cast<L>(best[m]);
+                }
+            }
+        }
+    });
+    return labels;
+}
+
+// Renders the image in horizontal bands of at most bandRows rows and hands each band's labels to
+// sink(labels, firstRow, rows) before the next one is computed, so memory is bounded by the band
+// rather than the image. The labels index the original points. Sites stay in image coordinates
+// and only the band's rows are offset, so every key is the one the full render computes and the
+// bands match it pixel for pixel; Fortune cells are built once for the whole image for the same
+// reason. Jump flooding seeds sites by clamping them into the image, which is wrong for sites in
+// other bands, so it uses the grid here.
+template<class M, class L = int, class Sink>
+bool renderBands(const std::vector<Point> &points, const RenderOptions &options, int bandRows, Sink &&sink) {
+    RenderOptions band = options;
+    if (band.mode == SearchMode::JUMP_FLOOD || band.mode == SearchMode::JUMP_FLOOD_CHECK) {
+        if (options.verbose) std::cout << "Jump flooding cannot run in bands, using the grid instead...\n";
+        band.mode = SearchMode::GRID;
+    }
+    if (band.mode == SearchMode::FORTUNE && !std::is_same_v<M, EuclideanMetric>) {
+        if (options.verbose) std::cout << "Fortune sweep only builds Euclidean cells, using the grid instead...\n";
+        band.mode = SearchMode::GRID;
+    }
+    bandRows = std::max(1, bandRows);
+    std::vector<Point> pixels = toPixelSpace(points, options.view);
+    std::vector<VoronoiCell> cells;
+    if (band.mode == SearchMode::FORTUNE) {
+        cells = voronoiCells(pixels, -1, -1, options.width, options.height);
+    }
+
+    for (int y0 = 0; y0 < options.height; y0 += bandRows) {
+        band.firstRow = y0;
+        band.height = std::min(bandRows, options.height - y0);
+        std::vector<L> labels;
+        if (band.mode == SearchMode::FORTUNE) {
+            PROFILE_STAGE("raster");
+            rasterizeCells(cells, options.width, band.height, labels, y0);
+        } else {
+            labels = computeLabels<M, L>(pixels, band);
+        }
+        if (!sink(labels, y0, band.height)) return false;
+    }
+    return true;
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vector>
+#include "grid.h"
+#include "tiles.h"
+
+// Half-open pixel rectangle; empty when x0 >= x1.
+struct PixelRect {
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+    bool empty() const {
+        return x0 >= x1 || y0 >= y1;
+    }
+
+    void add(int x, int y) {
+        if (empty()) {
+            *this = {x, y, x + 1, y + 1};
+            return;
+        }
+        x0 = std::min(x0, x);
+        y0 = std::min(y0, y);
+        x1 = std::max(x1, x + 1);
+        y1 = std::max(y1, y + 1);
+    }
+};
+
+// Free slots per grid cell for sites added or moved in after a build.
+const int GRID_SPARE_SLOTS = 2;
+
+// Persistent label buffer that follows single-site edits. Site indices never change: deleted
+// sites stay in the arrays as dead entries, so labels and colours remain valid across edits.
+// The grid is edited in place too, only in the cells a site leaves and enters; it is rebuilt
+// only when a site lands outside it or in a cell with no free slot.
+// Each site keeps the bounding box of the pixels it owns (a superset once its cell shrinks),
+// which bounds the pixels a delete has to reassign; an add claims its new cell by flooding
+// outwards from the site.
+template<class M>
+struct RenderState {
+    int width, height;
+    std::vector<Point> points;
+    std::vector<bool> alive;
+    std::vector<int> labels;
+    std::vector<PixelRect> extents;
+    PixelRect dirty;
+    SiteGrid grid;
+    std::vector<unsigned> visited;
+    unsigned visitStamp = 0;
+
+    RenderState(const std::vector<Point> &initial, int width, int height, int threads)
+            : width(width), height(height), points(initial), alive(initial.size(), true),
+              labels(static_cast<size_t>(width) * height, -1), extents(initial.size()),
+              visited(labels.size(), 0) {
+        grid.build(points, alive, GRID_SPARE_SLOTS);
+        forEachTile(width, height, threads, [&](const Tile &tile) {
+            for (int y = tile.y0; y < tile.y1; ++y) {
+                for (int x = tile.x0; x < tile.x1; ++x) {
+                    labels[index(x, y)] = grid.nearest<M>(static_cast<float>(x), static_cast<float>(y));
+                }
+            }
+        });
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                int owner = labels[index(x, y)];
+                if (owner != -1) extents[owner].add(x, y);
+            }
+        }
+        dirty = {0, 0, width, height};
+    }
+
+    int addSite(const Point &p) {
+        points.push_back(p);
+        alive.push_back(true);
+        extents.emplace_back();
+        int site = static_cast<int>(points.size()) - 1;
+        dirty = {};
+        insertIntoGrid(site);
+        claim(site);
+        return site;
+    }
+
+    void moveSite(int site, double x, double y) {
+        dirty = {};
+        alive[site] = false;
+        grid.remove(site, points[site]);
+        release(site);
+        points[site].x = x;
+        points[site].y = y;
+        alive[site] = true;
+        insertIntoGrid(site);
+        claim(site);
+    }
+
+    void deleteSite(int site) {
+        dirty = {};
+        alive[site] = false;
+        grid.remove(site, points[site]);
+        release(site);
+    }
+
+    void insertIntoGrid(int site) {
+        if (!grid.insert(site, points[site])) grid.build(points, alive, GRID_SPARE_SLOTS);
+    }
+
+    std::vector<Point> livePoints() const {
+        std::vector<Point> live;
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (alive[i]) live.push_back(points[i]);
+        }
+        return live;
+    }
+
+    size_t index(int x, int y) const {
+        return static_cast<size_t>(y) * width + x;
+    }
+
+    float keyAt(int site, int x, int y) const {
+        PROFILE_DISTANCES(1);
+        return M::key(static_cast<float>(points[site].x) - static_cast<float>(x),
+                      static_cast<float>(points[site].y) - static_cast<float>(y));
+    }
+
+    // Hands every pixel of a dead site to the nearest live one.
+    void release(int site) {
+        PixelRect box = extents[site];
+        extents[site] = {};
+        for (int y = box.y0; y < box.y1; ++y) {
+            for (int x = box.x0; x < box.x1; ++x) {
+                size_t idx = index(x, y);
+                if (labels[idx] != site) continue;
+                int owner = grid.nearest<M>(static_cast<float>(x), static_cast<float>(y));
+                labels[idx] = owner;
+                if (owner != -1) extents[owner].add(x, y);
+                dirty.add(x, y);
+            }
+        }
+    }
+
+    // Floods out from the site over every pixel where it is within 3 px of beating the current
+    // owner. Lp cells are star-shaped around their site and the difference of two distances
+    // changes by at most 2 * sqrt(2) per pixel step, so that band is 8-connected and covers
+    // every pixel the site wins. Sites outside the image have no seed pixel and scan it all.
+    void claim(int site) {
+        int sx = static_cast<int>(std::lround(points[site].x));
+        int sy = static_cast<int>(std::lround(points[site].y));
+        if (sx < 0 || sx >= width || sy < 0 || sy >= height) {
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    tryClaim(site, x, y);
+                }
+            }
+            return;
+        }
+
+        if (++visitStamp == 0) {
+            std::fill(visited.begin(), visited.end(), 0);
+            visitStamp = 1;
+        }
+        std::vector<std::pair<int, int>> stack = {{sx, sy}};
+        visited[index(sx, sy)] = visitStamp;
+        while (!stack.empty()) {
+            auto [x, y] = stack.back();
+            stack.pop_back();
+            if (!tryClaim(site, x, y)) continue;
+
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int nx = x + dx, ny = y + dy;
+                    if (nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
+                    if (visited[index(nx, ny)] == visitStamp) continue;
+                    visited[index(nx, ny)] = visitStamp;
+                    stack.push_back({nx, ny});
+                }
+            }
+        }
+    }
+
+    // Takes the pixel if the site now wins it; returns whether the flood should continue here.
+    bool tryClaim(int site, int x, int y) {
+        size_t idx = index(x, y);
+        int owner = labels[idx];
+        float key = keyAt(site, x, y);
+        if (!(key < M::keyOf(NO_SITE_DIST))) return false;
+        if (owner == -1) {
+            labels[idx] = site;
+            extents[site].add(x, y);
+            dirty.add(x, y);
+            return true;
+        }
+
+        float ownerKey = keyAt(owner, x, y);
+        if (key < ownerKey || (key == ownerKey && site < owner)) {
+            labels[idx] = site;
+            extents[site].add(x, y);
+            dirty.add(x, y);
+            return true;
+        }
+        return M::distance(key) <= M::distance(ownerKey) + 3.0f;
+    }
+};
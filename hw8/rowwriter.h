@@ -0,0 +1,57 @@
+#pragma once
+
+#include <SDL.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Image file written one band of rows at a time, so images larger than memory can be saved
+// while they are rendered. Rows come from the top of an RGBA32 surface.
+class RowWriter {
+public:
+    virtual ~RowWriter() = default;
+
+    virtual bool open(const std::string &path, int width, int height) = 0;
+
+    virtual bool writeRows(const SDL_Surface *surface, int rows) = 0;
+
+    virtual bool close() = 0;
+};
+
+// Binary PPM (P6); alpha is dropped.
+class PpmWriter : public RowWriter {
+public:
+    bool open(const std::string &path, int width, int height) override {
+        out.open(path, std::ios::binary);
+        if (!out.is_open()) return false;
+        this->width = width;
+        out << "P6\n" << width << " " << height << "\n255\n";
+        return out.good();
+    }
+
+    bool writeRows(const SDL_Surface *surface, int rows) override {
+        row.resize(static_cast<size_t>(width) * 3);
+        for (int y = 0; y < rows; ++y) {
+            const Uint8 *src = static_cast<const Uint8 *>(surface->pixels) + static_cast<size_t>(y) * surface->pitch;
+            for (int x = 0; x < width; ++x) {
+                Uint8 r, g, b, a;
+                SDL_GetRGBA(reinterpret_cast<const Uint32 *>(src)[x], surface->format, &r, &g, &b, &a);
+                row[3 * x] = static_cast<char>(r);
+                row[3 * x + 1] = static_cast<char>(g);
+                row[3 * x + 2] = static_cast<char>(b);
+            }
+            out.write(row.data(), static_cast<std::streamsize>(row.size()));
+        }
+        return out.good();
+    }
+
+    bool close() override {
+        out.close();
+        return !out.fail();
+    }
+
+private:
+    std::ofstream out;
+    std::vector<char> row;
+    int width = 0;
+};
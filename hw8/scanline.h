@@ -0,0 +1,69 @@
+#pragma once
+
+#include <numeric>
+#include <vector>
+#include "metrics.h"
+#include "tiles.h"
+
+// Sites sorted by x (then by index), so a search can walk outward from the query's column and
+// stop in each direction once |dx| alone, with the largest weight, is farther than the best
+// candidate.
+struct SortedSites {
+    std::vector<float> xs, ys, ws;
+    std::vector<int> index;
+    float maxWeight = 0;
+
+    explicit SortedSites(const std::vector<Point> &points) {
+        index.resize(points.size());
+        std::iota(index.begin(), index.end(), 0);
+        std::sort(index.begin(), index.end(), [&](int a, int b) {
+            return points[a].x < points[b].x || (points[a].x == points[b].x && a < b);
+        });
+        for (int i: index) {
+            xs.push_back(static_cast<float>(points[i].x));
+            ys.push_back(static_cast<float>(points[i].y));
+            ws.push_back(static_cast<float>(points[i].weight));
+        }
+        if (!ws.empty()) maxWeight = *std::max_element(ws.begin(), ws.end());
+    }
+};
+
+// Walks one tile row left to right. Each pixel starts with the previous pixel's winner as its
+// bound, which is almost always the answer, so the sweep rejects nearly everything else on dx.
+template<class M, class L>
+void scanlineRow(const SortedSites &sites, int y, int x0, int x1, L *labels, const M &metric = M()) {
+    int n = static_cast<int>(sites.xs.size());
+    float py = static_cast<float>(y);
+    int pos = static_cast<int>(std::lower_bound(sites.xs.begin(), sites.xs.end(), static_cast<float>(x0)) -
+                               sites.xs.begin());
+    int prev = -1;
+
+    for (int x = x0; x < x1; ++x) {
+        float px = static_cast<float>(x);
+        while (pos < n && sites.xs[pos] < px) ++pos;
+
+        float minKey = M::keyOf(NO_SITE_DIST);
+        int best = -1;
+        if (prev != -1) {
+            minKey = siteKey(sites.xs[prev] - px, sites.ys[prev] - py, sites.ws[prev], metric);
+            best = prev;
+        }
+
+        auto consider = [&](int j) {
+            float key = siteKey(sites.xs[j] - px, sites.ys[j] - py, sites.ws[j], metric);
+            if (key < minKey || (key == minKey && (best == -1 || sites.index[j] < sites.index[best]))) {
+                minKey = key;
+                best = j;
+            }
+        };
+        auto reachable = [&](int j) {
+            return siteKey(sites.xs[j] - px, 0.0f, sites.maxWeight, metric) <= minKey;
+        };
+        for (int j = pos; j < n && reachable(j); ++j) consider(j);
+        for (int j = pos - 1; j >= 0 && reachable(j); --j) consider(j);
+
+        if (best != -1 && !(minKey < M::keyOf(NO_SITE_DIST))) best = -1;
+        prev = best;
+        labels[x - x0] = static_cast<L>((best == -1) ? -1 : sites.index[best]);
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <immintrin.h>
+#include <limits>
+#include <new>
+#include <vector>
+#include "metrics.h"
+
+// Sites as aligned float x[] / y[] arrays, padded to a multiple of 8 with sites at infinity
+// so the vector kernels never need a scalar tail. w[] holds the weights for the scalar search.
+struct SiteBuffer {
+    static constexpr std::align_val_t ALIGNMENT{32};
+
+    float *x = nullptr;
+    float *y = nullptr;
+    float *w = nullptr;
+    int count = 0;
+    int padded = 0;
+
+    explicit SiteBuffer(const std::vector<Point> &points) {
+        count = static_cast<int>(points.size());
+        padded = (count + 7) / 8 * 8;
+        x = static_cast<float *>(::operator new(std::max(padded, 8) * sizeof(float), ALIGNMENT));
+        y = static_cast<float *>(::operator new(std::max(padded, 8) * sizeof(float), ALIGNMENT));
+        w = static_cast<float *>(::operator new(std::max(padded, 8) * sizeof(float), ALIGNMENT));
+        for (int i = 0; i < padded; ++i) {
+            x[i] = (i < count) ? static_cast<float>(points[i].x) : std::numeric_limits<float>::infinity();
+            y[i] = (i < count) ? static_cast<float>(points[i].y) : std::numeric_limits<float>::infinity();
+            w[i] = (i < count) ? static_cast<float>(points[i].weight) : 0.0f;
+        }
+    }
+
+    SiteBuffer(const SiteBuffer &) = delete;
+
+    SiteBuffer &operator=(const SiteBuffer &) = delete;
+
+    ~SiteBuffer() {
+        ::operator delete(x, ALIGNMENT);
+        ::operator delete(y, ALIGNMENT);
+        ::operator delete(w, ALIGNMENT);
+    }
+};
+
+template<class M>
+using SimdKernel = int (*)(const SiteBuffer &, float, float, const M &);
+
+int reduceLanes(const float *keys, const int *indices, int lanes) {
+    float minKey = keys[0];
+    int best = indices[0];
+    for (int i = 1; i < lanes; ++i) {
+        if (indices[i] == -1) continue;
+        if (best == -1 || keys[i] < minKey || (keys[i] == minKey && indices[i] < best)) {
+            minKey = keys[i];
+            best = indices[i];
+        }
+    }
+    return best;
+}
+
+// Brute-force reference: first site with the smallest key wins, -1 if none is closer than NO_SITE_DIST.
+template<class M>
+int nearestSiteScalar(const SiteBuffer &sites, float px, float py, const M &metric = M()) {
+    float minKey = M::keyOf(NO_SITE_DIST);
+    int best = -1;
+    for (int i = 0; i < sites.count; ++i) {
+        float key = siteKey(sites.x[i] - px, sites.y[i] - py, sites.w[i], metric);
+        if (key < minKey) {
+            minKey = key;
+            best = i;
+        }
+    }
+    return best;
+}
+
+template<class M>
+int nearestSiteSSE(const SiteBuffer &sites, float px, float py, const M &metric = M()) {
+    PROFILE_DISTANCES(sites.padded);
+    __m128 vx = _mm_set1_ps(px);
+    __m128 vy = _mm_set1_ps(py);
+    __m128 bestKey = _mm_set1_ps(M::keyOf(NO_SITE_DIST));
+    __m128i bestIdx = _mm_set1_epi32(-1);
+    __m128i idx = _mm_set_epi32(3, 2, 1, 0);
+    const __m128i step = _mm_set1_epi32(4);
+
+    for (int i = 0; i < sites.padded; i += 4) {
+        __m128 key = metric.key(_mm_sub_ps(_mm_load_ps(sites.x + i), vx), _mm_sub_ps(_mm_load_ps(sites.y + i), vy));
+        __m128 closer = _mm_cmplt_ps(key, bestKey);
+        bestKey = _mm_or_ps(_mm_and_ps(closer, key), _mm_andnot_ps(closer, bestKey));
+        __m128i closerInt = _mm_castps_si128(closer);
+        bestIdx = _mm_or_si128(_mm_and_si128(closerInt, idx), _mm_andnot_si128(closerInt, bestIdx));
+        idx = _mm_add_epi32(idx, step);
+    }
+
+    alignas(16) float keys[4];
+    alignas(16) int indices[4];
+    _mm_store_ps(keys, bestKey);
+    _mm_store_si128(reinterpret_cast<__m128i *>(indices), bestIdx);
+    return reduceLanes(keys, indices, 4);
+}
+
+template<class M>
+TARGET_AVX2 int nearestSiteAVX2(const SiteBuffer &sites, float px, float py, const M &metric = M()) {
+    PROFILE_DISTANCES(sites.padded);
+    __m256 vx = _mm256_set1_ps(px);
+    __m256 vy = _mm256_set1_ps(py);
+    __m256 bestKey = _mm256_set1_ps(M::keyOf(NO_SITE_DIST));
+    __m256i bestIdx = _mm256_set1_epi32(-1);
+    __m256i idx = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i step = _mm256_set1_epi32(8);
+
+    for (int i = 0; i < sites.padded; i += 8) {
+        __m256 key = metric.key(_mm256_sub_ps(_mm256_load_ps(sites.x + i), vx),
+                                _mm256_sub_ps(_mm256_load_ps(sites.y + i), vy));
+        __m256 closer = _mm256_cmp_ps(key, bestKey, _CMP_LT_OQ);
+        bestKey = _mm256_blendv_ps(bestKey, key, closer);
+        bestIdx = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIdx),
+                                                       _mm256_castsi256_ps(idx), closer));
+        idx = _mm256_add_epi32(idx, step);
+    }
+
+    alignas(32) float keys[8];
+    alignas(32) int indices[8];
+    _mm256_store_ps(keys, bestKey);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(indices), bestIdx);
+    return reduceLanes(keys, indices, 8);
+}
+
+template<class M>
+SimdKernel<M> selectSimdKernel(const char **name) {
+    if (SDL_HasAVX2()) {
+        *name = "AVX2";
+        return nearestSiteAVX2<M>;
+    }
+    if (SDL_HasSSE2()) {
+        *name = "SSE2";
+        return nearestSiteSSE<M>;
+    }
+    *name = "scalar";
+    return nearestSiteScalar<M>;
+}
@@ -0,0 +1,775 @@
+#include <gtest/gtest.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "animate.h"
+#include "delaunay.h"
+#include "fortune.h"
+#include "pointfile.h"
+#include "png.h"
+#include "render.h"
+#include "render_state.h"
+
+const int TEST_WIDTH = 150;   // not a multiple of TILE_SIZE, so edge tiles are partial
+const int TEST_HEIGHT = 110;
+
+enum PointSet {
+    UNIFORM,
+    CLUSTERED,
+    LATTICE,
+    OFF_IMAGE
+};
+
+const char *pointSetName(int kind) {
+    switch (kind) {
+        case CLUSTERED:
+            return "clustered";
+        case LATTICE:
+            return "lattice";
+        case OFF_IMAGE:
+            return "off-image";
+        default:
+            return "uniform";
+    }
+}
+
+// n sites in pixel space with weights of up to a few pixels. Lattice sites sit on whole pixels
+// ten apart, so many pixels are exact ties; off-image sites lie in a thin strip outside the image.
+std::vector<Point> testPoints(int kind, int n, unsigned seed = 1) {
+    std::mt19937 rng(seed * 7919 + n * 31 + kind);
+    std::uniform_real_distribution<double> x(0, TEST_WIDTH), y(0, TEST_HEIGHT), weight(0, 4);
+    std::normal_distribution<double> spread(0, 6);
+    std::uniform_int_distribution<int> cellX(0, TEST_WIDTH / 10), cellY(0, TEST_HEIGHT / 10);
+    std::vector<Point> points(n);
+    for (auto &p: points) {
+        if (kind == CLUSTERED) {
+            p.x = 40 + spread(rng);
+            p.y = 70 + spread(rng);
+        } else if (kind == LATTICE) {
+            p.x = 10 * cellX(rng);
+            p.y = 10 * cellY(rng);
+        } else if (kind == OFF_IMAGE) {
+            p.x = 3 * x(rng) - TEST_WIDTH;
+            p.y = TEST_HEIGHT + 40 + y(rng) * 0.05;
+        } else {
+            p.x = x(rng);
+            p.y = y(rng);
+        }
+        p.weight = weight(rng);
+        p.color = {static_cast<Uint8>(rng()), static_cast<Uint8>(rng()), static_cast<Uint8>(rng()), 255};
+    }
+    return points;
+}
+
+template<class M>
+std::vector<int> renderLabels(const std::vector<Point> &points, SearchMode mode, int threads = 4,
+                              double lpExponent = 3) {
+    RenderOptions options;
+    options.mode = mode;
+    options.width = TEST_WIDTH;
+    options.height = TEST_HEIGHT;
+    options.threads = threads;
+    options.verbose = false;
+    options.lpExponent = lpExponent;
+    return computeLabels<M>(points, options);
+}
+
+size_t countDifferences(const std::vector<int> &a, const std::vector<int> &b) {
+    if (a.size() != b.size()) return std::max(a.size(), b.size());
+    size_t differences = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i] != b[i]) ++differences;
+    }
+    return differences;
+}
+
+// Every point set and size, from a single site up to maxSites, rendered in mode and by brute force.
+template<class M>
+void expectSameAsBruteForce(SearchMode mode, const char *metric, int maxSites = 3000, double lpExponent = 3) {
+    for (int kind: {UNIFORM, CLUSTERED, LATTICE, OFF_IMAGE}) {
+        for (int n: {1, 2, 7, 300, 3000}) {
+            if (n > maxSites) continue;
+            std::vector<Point> points = testPoints(kind, n);
+            EXPECT_EQ(countDifferences(renderLabels<M>(points, mode, 4, lpExponent),
+                                       renderLabels<M>(points, SearchMode::BRUTE_FORCE, 4, lpExponent)), 0u)
+                    << metric << ", " << pointSetName(kind) << ", " << n << " sites";
+        }
+    }
+}
+
+TEST(GridSearchTest, MatchesBruteForce) {
+    expectSameAsBruteForce<EuclideanMetric>(SearchMode::GRID, "euclidean");
+    expectSameAsBruteForce<ManhattanMetric>(SearchMode::GRID, "manhattan");
+    expectSameAsBruteForce<ChebyshevMetric>(SearchMode::GRID, "chebyshev");
+}
+
+TEST(QuadtreeTest, MatchesBruteForce) {
+    expectSameAsBruteForce<EuclideanMetric>(SearchMode::QUADTREE, "euclidean");
+    expectSameAsBruteForce<ManhattanMetric>(SearchMode::QUADTREE, "manhattan");
+    expectSameAsBruteForce<ChebyshevMetric>(SearchMode::QUADTREE, "chebyshev");
+    expectSameAsBruteForce<LpMetric<3>>(SearchMode::QUADTREE, "p = 3");
+    expectSameAsBruteForce<PowerMetric>(SearchMode::QUADTREE, "power");
+    expectSameAsBruteForce<AdditiveMetric>(SearchMode::QUADTREE, "additive");
+    // Brute force is slow with fractional powers, so these stop at 300 sites.
+    for (float p: {1.0f, 1.5f, 0.5f}) {
+        // Below 1 there is no triangle inequality and the quadtree hands the render to the grid.
+        EXPECT_EQ(quadtreeSupports(MinkowskiMetric(p)), p >= 1) << "p = " << p;
+        expectSameAsBruteForce<MinkowskiMetric>(SearchMode::QUADTREE, ("minkowski p = " + std::to_string(p)).c_str(),
+                                                300, p);
+    }
+}
+
+TEST(MinkowskiTest, ConcurrentExponentsMatchSequential) {
+    // The exponent travels with each render, so two renders with different ones on two threads
+    // give what each gives alone.
+    std::vector<Point> points = testPoints(UNIFORM, 300);
+    std::vector<int> aloneLow = renderLabels<MinkowskiMetric>(points, SearchMode::GRID, 2, 1.5);
+    std::vector<int> aloneHigh = renderLabels<MinkowskiMetric>(points, SearchMode::GRID, 2, 4.5);
+    EXPECT_NE(countDifferences(aloneLow, aloneHigh), 0u);
+    for (int round = 0; round < 5; ++round) {
+        std::vector<int> low, high;
+        std::thread worker([&] { low = renderLabels<MinkowskiMetric>(points, SearchMode::GRID, 2, 1.5); });
+        high = renderLabels<MinkowskiMetric>(points, SearchMode::GRID, 2, 4.5);
+        worker.join();
+        EXPECT_EQ(countDifferences(low, aloneLow), 0u) << "round " << round;
+        EXPECT_EQ(countDifferences(high, aloneHigh), 0u) << "round " << round;
+    }
+}
+
+// n sites on a square lattice over a side x side image; with these spacings many cell edges
+// are horizontal or vertical and fall exactly on pixel rows and columns.
+std::vector<Point> latticePoints(int n, int side) {
+    int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(n))));
+    double spacing = static_cast<double>(side) / columns;
+    std::vector<Point> points(n);
+    for (int i = 0; i < n; ++i) {
+        points[i].x = (i % columns + 0.5) * spacing;
+        points[i].y = (i / columns + 0.5) * spacing;
+    }
+    return points;
+}
+
+TEST(FortuneRasterTest, LatticeLeavesNoPixelUnlabeled) {
+    for (int side: {256, 300, 317}) {
+        for (int n: {100, 700, 2000, 5000}) {
+            std::vector<int> labels;
+            rasterizeCells(voronoiCells(latticePoints(n, side), -1, -1, side, side), side, side, labels);
+            EXPECT_EQ(std::count(labels.begin(), labels.end(), -1), 0) << n << " sites on " << side << "x" << side;
+        }
+    }
+}
+
+TEST(FortuneRasterTest, AxisAlignedEdgesOnPixelCentres) {
+    // Sites two rows apart put a horizontal edge on every odd row, and sites at x = 10 and
+    // x = 20 put a vertical edge on column 15, which goes to the lower, left-hand index.
+    std::vector<Point> points;
+    for (int y = 0; y < 40; y += 2) {
+        points.push_back({10, static_cast<double>(y), {}});
+        points.push_back({20, static_cast<double>(y), {}});
+    }
+    std::vector<int> labels;
+    rasterizeCells(voronoiCells(points, -1, -1, 30, 40), 30, 40, labels);
+    EXPECT_EQ(std::count(labels.begin(), labels.end(), -1), 0);
+    for (int y = 0; y < 40; ++y) {
+        EXPECT_EQ(labels[y * 30 + 15] % 2, 0) << "row " << y;
+    }
+}
+
+TEST(FortuneRasterTest, ConcurrentSweepsMatchSequential) {
+    // Each sweep keeps its own beach line position, so sweeps on two threads give the cells
+    // that each one gives alone.
+    std::mt19937 rng(21);
+    std::uniform_real_distribution<double> coordinate(0, 200);
+    std::vector<Point> a(3000), b(3000);
+    for (auto &p: a) p = {coordinate(rng), coordinate(rng), {}};
+    for (auto &p: b) p = {coordinate(rng), coordinate(rng), {}};
+    std::vector<int> aloneA, aloneB, togetherA, togetherB;
+    rasterizeCells(voronoiCells(a, -1, -1, 200, 200), 200, 200, aloneA);
+    rasterizeCells(voronoiCells(b, -1, -1, 200, 200), 200, 200, aloneB);
+    std::thread worker([&] { rasterizeCells(voronoiCells(a, -1, -1, 200, 200), 200, 200, togetherA); });
+    rasterizeCells(voronoiCells(b, -1, -1, 200, 200), 200, 200, togetherB);
+    worker.join();
+    EXPECT_EQ(togetherA, aloneA);
+    EXPECT_EQ(togetherB, aloneB);
+}
+
+// Random adds, moves and deletes from a clustered start, so many land outside the grid built so
+// far, with the labels checked after every edit against a grid built from scratch over the live
+// sites.
+template<class M>
+void expectEditsMatchFullRender(const char *metric) {
+    std::mt19937 rng(8);
+    std::uniform_real_distribution<double> x(-20, TEST_WIDTH + 20), y(-20, TEST_HEIGHT + 20);
+    std::vector<Point> initial = testPoints(CLUSTERED, 40);
+    for (auto &p: initial) p.weight = 0;
+    RenderState<M> state(initial, TEST_WIDTH, TEST_HEIGHT, 3);
+
+    for (int edit = 0; edit < 300; ++edit) {
+        std::vector<int> live;
+        for (size_t i = 0; i < state.points.size(); ++i) {
+            if (state.alive[i]) live.push_back(static_cast<int>(i));
+        }
+        int action = live.size() < 5 ? 0 : static_cast<int>(rng() % 3);
+        int site = live.empty() ? -1 : live[rng() % live.size()];
+        if (action == 0) {
+            state.addSite({x(rng), y(rng), {}});
+        } else if (action == 1) {
+            state.moveSite(site, x(rng), y(rng));
+        } else {
+            state.deleteSite(site);
+        }
+
+        SiteGrid full;
+        full.build(state.points, state.alive);
+        std::vector<int> expected(state.labels.size());
+        for (int py = 0; py < TEST_HEIGHT; ++py) {
+            for (int px = 0; px < TEST_WIDTH; ++px) {
+                expected[state.index(px, py)] = full.nearest<M>(static_cast<float>(px), static_cast<float>(py));
+            }
+        }
+        ASSERT_EQ(countDifferences(state.labels, expected), 0u)
+                << metric << ", edit " << edit << " (" << "amd"[action] << " " << site << ")";
+    }
+}
+
+TEST(RenderStateTest, EditsMatchFullRender) {
+    expectEditsMatchFullRender<EuclideanMetric>("euclidean");
+    expectEditsMatchFullRender<ManhattanMetric>("manhattan");
+    expectEditsMatchFullRender<ChebyshevMetric>("chebyshev");
+}
+
+// Sites in a 300 x 220 world drifting by up to `speed` world units a frame, rendered by the
+// Animator and from scratch on every frame. Returns the pixels the Animator searched again.
+template<class M>
+size_t expectAnimationMatchesFullRenders(double speed, const char *metric) {
+    std::mt19937 rng(static_cast<unsigned>(speed * 100));
+    std::uniform_real_distribution<double> x(0, 300), y(0, 220), velocity(-speed, speed);
+    std::vector<Point> points(200);
+    std::vector<Velocity> velocities(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        points[i] = {x(rng), y(rng), {}};
+        // Every tenth site stands still, so moving ones pass by fixed cells.
+        if (i % 10 != 0) velocities[i] = {velocity(rng), velocity(rng)};
+    }
+
+    RenderOptions options;
+    options.width = TEST_WIDTH;
+    options.height = TEST_HEIGHT;
+    options.threads = 3;
+    options.verbose = false;
+    options.view = windowView(0, 0, 300, 220, TEST_WIDTH, TEST_HEIGHT);
+    RenderOptions full = options;
+    full.mode = SearchMode::BRUTE_FORCE;
+
+    Animator<M> animator(options);
+    size_t searched = 0;
+    for (int frame = 0; frame < 60; ++frame) {
+        const std::vector<int> &labels = animator.render(points);
+        EXPECT_EQ(countDifferences(labels, computeLabels<M>(toPixelSpace(points, options.view), full)), 0u)
+                << metric << ", speed " << speed << ", frame " << frame;
+        if (frame > 0) searched += animator.lastVerified();
+        advancePoints(points, velocities, 1);
+    }
+    return searched;
+}
+
+TEST(AnimatorTest, EveryFrameMatchesFullRender) {
+    const size_t frames = 59, pixels = static_cast<size_t>(TEST_WIDTH) * TEST_HEIGHT;
+    // A world unit is half a pixel here, so these are a tenth of a pixel, a pixel and 40 pixels
+    // a frame.
+    for (double speed: {0.05, 0.5, 20.0}) {
+        size_t searched = expectAnimationMatchesFullRenders<EuclideanMetric>(speed, "euclidean");
+        expectAnimationMatchesFullRenders<ManhattanMetric>(speed, "manhattan");
+        expectAnimationMatchesFullRenders<ChebyshevMetric>(speed, "chebyshev");
+        // Slow drift is the case the Animator is for; it must not fall back to full searches.
+        if (speed < 0.1) EXPECT_LT(searched, frames * pixels / 4) << "speed " << speed;
+    }
+}
+
+TEST(TileRenderTest, SameLabelsForAnyThreadCount) {
+    static_assert(TEST_WIDTH % TILE_SIZE != 0 && TEST_HEIGHT % TILE_SIZE != 0, "edge tiles must be partial");
+    std::vector<Point> points = testPoints(UNIFORM, 500);
+    for (SearchMode mode: {SearchMode::BRUTE_FORCE, SearchMode::GRID, SearchMode::SIMD, SearchMode::SCANLINE,
+                           SearchMode::JUMP_FLOOD, SearchMode::QUADTREE}) {
+        EXPECT_EQ(countDifferences(renderLabels<EuclideanMetric>(points, mode, 1),
+                                   renderLabels<EuclideanMetric>(points, mode, 5)), 0u)
+                << searchModeName(mode);
+        EXPECT_EQ(countDifferences(renderLabels<ChebyshevMetric>(points, mode, 1),
+                                   renderLabels<ChebyshevMetric>(points, mode, 5)), 0u)
+                << searchModeName(mode);
+    }
+}
+
+// The decoding side of the PNG tests is zlib, so a stream our deflater gets wrong (bad Huffman
+// tables, misaligned blocks between chunks, a wrong combined Adler-32) fails to inflate.
+struct DecodedPng {
+    int width = 0, height = 0, colorType = 0;
+    int idatChunks = 0;
+    std::string palette, alphas;
+    std::vector<Uint8> pixels;
+};
+
+uint32_t readBigEndian(const std::string &bytes, size_t at) {
+    return static_cast<uint32_t>(static_cast<Uint8>(bytes[at])) << 24 |
+           static_cast<uint32_t>(static_cast<Uint8>(bytes[at + 1])) << 16 |
+           static_cast<uint32_t>(static_cast<Uint8>(bytes[at + 2])) << 8 | static_cast<Uint8>(bytes[at + 3]);
+}
+
+// Reads, checks and inflates the file, undoing every row filter the format allows.
+DecodedPng decodePng(const std::string &path) {
+    DecodedPng png;
+    std::ifstream in(path, std::ios::binary);
+    std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(file.substr(0, 8), std::string("\x89PNG\r\n\x1a\n", 8));
+
+    std::string compressed;
+    bool ended = false;
+    for (size_t at = 8; at + 12 <= file.size() && !ended; ) {
+        uint32_t length = readBigEndian(file, at);
+        std::string type = file.substr(at + 4, 4), payload = file.substr(at + 8, length);
+        uint32_t crc = ::crc32(0, reinterpret_cast<const Bytef *>(file.data() + at + 4), length + 4);
+        EXPECT_EQ(readBigEndian(file, at + 8 + length), crc) << type << " chunk at " << at;
+        if (type == "IHDR") {
+            png.width = static_cast<int>(readBigEndian(payload, 0));
+            png.height = static_cast<int>(readBigEndian(payload, 4));
+            png.colorType = payload[9];
+        } else if (type == "PLTE") {
+            png.palette = payload;
+        } else if (type == "tRNS") {
+            png.alphas = payload;
+        } else if (type == "IDAT") {
+            compressed += payload;
+            ++png.idatChunks;
+        } else if (type == "IEND") {
+            ended = true;
+        }
+        at += 12 + length;
+    }
+    EXPECT_TRUE(ended);
+
+    int bpp = png.colorType == 3 ? 1 : 4;
+    size_t rowBytes = static_cast<size_t>(png.width) * bpp;
+    std::vector<Uint8> filtered(png.height * (rowBytes + 1));
+    uLongf size = filtered.size();
+    EXPECT_EQ(uncompress(filtered.data(), &size, reinterpret_cast<const Bytef *>(compressed.data()),
+                         compressed.size()), Z_OK);
+    EXPECT_EQ(size, filtered.size());
+
+    png.pixels.assign(png.height * rowBytes, 0);
+    for (int y = 0; y < png.height; ++y) {
+        const Uint8 *in = &filtered[y * (rowBytes + 1)];
+        Uint8 *row = &png.pixels[y * rowBytes];
+        const Uint8 *above = y > 0 ? row - rowBytes : nullptr;
+        for (size_t i = 0; i < rowBytes; ++i) {
+            int a = i >= static_cast<size_t>(bpp) ? row[i - bpp] : 0;
+            int b = above ? above[i] : 0;
+            int c = above && i >= static_cast<size_t>(bpp) ? above[i - bpp] : 0;
+            int predicted = 0;
+            switch (in[0]) {
+                case 1:
+                    predicted = a;
+                    break;
+                case 2:
+                    predicted = b;
+                    break;
+                case 3:
+                    predicted = (a + b) / 2;
+                    break;
+                case 4: {
+                    int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                    predicted = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                    break;
+                }
+                default:
+                    EXPECT_EQ(in[0], 0) << "filter of row " << y;
+            }
+            row[i] = static_cast<Uint8>(in[1 + i] + predicted);
+        }
+    }
+    return png;
+}
+
+// Writes rows of width pixels (RGBA, or indices when there is a palette) through PngWriter and
+// reads them back.
+DecodedPng roundTrip(const std::vector<Uint8> &pixels, int width, int threads,
+                     const std::vector<SDL_Color> &palette = {}) {
+    const std::string path = "png_round_trip_test.png";
+    int rowBytes = width * (palette.empty() ? 4 : 1);
+    int height = static_cast<int>(pixels.size()) / rowBytes;
+    PngWriter writer(threads, palette);
+    EXPECT_TRUE(writer.open(path, width, height));
+    for (int y = 0; y < height; ++y) writer.writeRow(&pixels[y * rowBytes]);
+    EXPECT_TRUE(writer.close());
+    DecodedPng png = decodePng(path);
+    std::remove(path.c_str());
+    EXPECT_EQ(png.width, width);
+    EXPECT_EQ(png.height, height);
+    return png;
+}
+
+// A flat Voronoi-like picture: a few colors in vertical bands with a noisy patch, so the rows
+// exercise runs, back-references one row up and literals.
+std::vector<Uint8> bandedPixels(int width, int height, int bpp, int colors) {
+    std::mt19937 rng(static_cast<unsigned>(width * 131 + height));
+    std::vector<Uint8> pixels(static_cast<size_t>(width) * height * bpp);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            Uint8 *p = &pixels[(static_cast<size_t>(y) * width + x) * bpp];
+            int band = (x + y / 3) / 17 % colors;
+            bool noisy = x < width / 8 && y % 5 == 0;
+            for (int k = 0; k < bpp; ++k) {
+                p[k] = noisy ? static_cast<Uint8>(rng() % (bpp == 1 ? colors : 256))
+                             : static_cast<Uint8>(bpp == 1 ? band : band * 40 + k * 7);
+            }
+        }
+    }
+    return pixels;
+}
+
+TEST(PngTest, Adler32CombineKnownAnswer) {
+    const Uint8 *text = reinterpret_cast<const Uint8 *>("Wikipedia");
+    EXPECT_EQ(png::adler32(text, 9), 0x11E60398u);
+    EXPECT_EQ(png::adler32Combine(png::adler32(text, 4), png::adler32(text + 4, 5), 5), 0x11E60398u);
+    EXPECT_EQ(png::adler32Combine(png::adler32(text, 9), png::adler32(text, 0), 0), 0x11E60398u);
+    EXPECT_EQ(png::adler32Combine(png::adler32(text, 0), png::adler32(text, 9), 9), 0x11E60398u);
+
+    // Splits on both sides of the modulus, with sums that wrap.
+    std::vector<Uint8> data(200000);
+    std::mt19937 rng(3);
+    for (auto &b: data) b = static_cast<Uint8>(rng() | 0xC0);
+    uint32_t whole = png::adler32(data.data(), data.size());
+    EXPECT_EQ(whole, ::adler32(1, data.data(), static_cast<uInt>(data.size())));
+    for (size_t split: {1, 5552, 65520, 65521, 65522, 131042, 199999}) {
+        EXPECT_EQ(png::adler32Combine(png::adler32(data.data(), split),
+                                      png::adler32(data.data() + split, data.size() - split), data.size() - split),
+                  whole) << "split at " << split;
+    }
+}
+
+TEST(PngTest, SingleRowRoundTrips) {
+    for (int width: {1, 2, 37, 300}) {
+        std::vector<Uint8> pixels = bandedPixels(width, 1, 4, 5);
+        DecodedPng png = roundTrip(pixels, width, 2);
+        EXPECT_EQ(png.colorType, 6);
+        EXPECT_EQ(png.pixels, pixels) << width << " pixels";
+    }
+}
+
+TEST(PngTest, SingleSymbolRoundTrips) {
+    // After filtering, one color is a single repeated byte, which leaves the literal alphabet
+    // with one used symbol and no distances when the image is one pixel wide.
+    for (int width: {1, 64}) {
+        std::vector<Uint8> rgba(static_cast<size_t>(width) * 40 * 4, 0);
+        EXPECT_EQ(roundTrip(rgba, width, 1).pixels, rgba) << width << " wide";
+        std::vector<Uint8> indices(static_cast<size_t>(width) * 40, 0);
+        EXPECT_EQ(roundTrip(indices, width, 1, {{9, 8, 7, 255}}).pixels, indices) << width << " wide";
+    }
+}
+
+TEST(PngTest, MultipleChunksRoundTrip) {
+    // 512 RGBA pixels are 2 KiB a row, so a chunk is 512 rows and this image takes three of them
+    // besides the zlib header and the trailer.
+    const int width = 512, height = 1300;
+    std::vector<Uint8> pixels = bandedPixels(width, height, 4, 6);
+    for (int threads: {1, 3}) {
+        DecodedPng png = roundTrip(pixels, width, threads);
+        EXPECT_EQ(png.idatChunks, 5) << threads << " threads";
+        EXPECT_EQ(png.pixels, pixels) << threads << " threads";
+    }
+}
+
+TEST(PngTest, IndexedRoundTrips) {
+    std::vector<SDL_Color> opaque = {{255, 0, 0, 255}, {0, 255, 0, 255}, {0, 0, 255, 255}, {9, 9, 9, 255}};
+    std::vector<Uint8> pixels = bandedPixels(333, 90, 1, 4);
+    DecodedPng png = roundTrip(pixels, 333, 2, opaque);
+    EXPECT_EQ(png.colorType, 3);
+    EXPECT_EQ(png.palette, std::string("\xFF\0\0\0\xFF\0\0\0\xFF\x09\x09\x09", 12));
+    EXPECT_TRUE(png.alphas.empty());
+    EXPECT_EQ(png.pixels, pixels);
+
+    std::vector<SDL_Color> translucent = opaque;
+    translucent[2].a = 128;
+    png = roundTrip(pixels, 333, 2, translucent);
+    EXPECT_EQ(png.alphas, std::string("\xFF\xFF\x80\xFF", 4));
+    EXPECT_EQ(png.pixels, pixels);
+}
+
+using EdgeSet = std::set<std::pair<int, int>>;
+
+EdgeSet edgeSet(const SiteAdjacency &adjacency) {
+    EdgeSet edges;
+    for (int i = 0; i + 1 < static_cast<int>(adjacency.offsets.size()); ++i) {
+        for (int k = adjacency.offsets[i]; k < adjacency.offsets[i + 1]; ++k) {
+            edges.insert({std::min(i, adjacency.neighbors[k]), std::max(i, adjacency.neighbors[k])});
+        }
+    }
+    return edges;
+}
+
+EdgeSet fortuneEdges(const std::vector<Point> &points) {
+    std::vector<int> ids(points.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    FortuneSweep sweep;
+    EdgeSet edges;
+    for (const auto &e: sweep.run(points, ids)) edges.insert({std::min(e.first, e.second), std::max(e.first, e.second)});
+    return edges;
+}
+
+// The first `built` sites passed to the constructor, the rest added one by one.
+EdgeSet insertedEdges(const std::vector<Point> &points, size_t built) {
+    Delaunay delaunay(std::vector<Point>(points.begin(), points.begin() + built));
+    for (size_t i = built; i < points.size(); ++i) delaunay.insert(points[i].x, points[i].y);
+    return edgeSet(delaunay.adjacency());
+}
+
+std::vector<Point> randomSites(int n, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coordinate(0, 1000);
+    std::vector<Point> points(n);
+    for (auto &p: points) p = {coordinate(rng), coordinate(rng), {}};
+    return points;
+}
+
+// Length of the part of the bisector of i and j that is closer to them than to any other site,
+// negative when there is none. Positive means (i, j) is in every Delaunay triangulation; about
+// zero means four or more sites are cocircular there and a triangulation may or may not use it.
+double voronoiEdgeLength(const std::vector<Point> &points, int i, int j) {
+    double mx = (points[i].x + points[j].x) / 2, my = (points[i].y + points[j].y) / 2;
+    double dx = points[i].y - points[j].y, dy = points[j].x - points[i].x;
+    double lo = -INFINITY, hi = INFINITY;
+    for (int k = 0; k < static_cast<int>(points.size()); ++k) {
+        if (k == i || k == j) continue;
+        // Closer to i than to k along m + t * d: a * t > b.
+        double ux = points[i].x - points[k].x, uy = points[i].y - points[k].y;
+        double a = 2 * (dx * ux + dy * uy);
+        double b = (points[i].x * points[i].x + points[i].y * points[i].y) -
+                   (points[k].x * points[k].x + points[k].y * points[k].y) - 2 * (mx * ux + my * uy);
+        if (a > 0) {
+            lo = std::max(lo, b / a);
+        } else if (a < 0) {
+            hi = std::min(hi, b / a);
+        } else if (b >= 0) {
+            return -INFINITY;
+        }
+    }
+    return (hi - lo) * std::hypot(dx, dy);
+}
+
+// With cocircular sites the triangulation is not unique, so the edges are checked against the
+// geometry instead: every edge with a Voronoi edge of positive length must be there, any other
+// edge must have one of zero length, and the count must match the reference triangulation's,
+// since every triangulation of the same sites has the same number of edges.
+void expectValidTriangulation(const std::vector<Point> &points, const EdgeSet &edges, const EdgeSet &reference,
+                              const char *name) {
+    const double tolerance = 1e-6;
+    EXPECT_EQ(edges.size(), reference.size()) << name;
+    for (int i = 0; i < static_cast<int>(points.size()); ++i) {
+        for (int j = i + 1; j < static_cast<int>(points.size()); ++j) {
+            double length = voronoiEdgeLength(points, i, j);
+            if (length > tolerance) {
+                EXPECT_TRUE(edges.count({i, j})) << name << ": missing " << i << "-" << j;
+            } else if (length < -tolerance) {
+                EXPECT_FALSE(edges.count({i, j})) << name << ": extra " << i << "-" << j;
+            }
+        }
+    }
+}
+
+TEST(DelaunayTest, SameEdgesAsFortuneOnRandomSites) {
+    for (int n: {3, 4, 10, 100, 2000, 20000}) {
+        std::vector<Point> points = randomSites(n, static_cast<unsigned>(n));
+        EXPECT_EQ(edgeSet(Delaunay(points).adjacency()), fortuneEdges(points)) << n << " sites";
+    }
+}
+
+TEST(DelaunayTest, ValidEdgesOnCocircularSites) {
+    std::mt19937 rng(18);
+    std::vector<std::vector<Point>> cases;
+    for (int side: {2, 3, 5, 12}) {
+        std::vector<Point> lattice;
+        for (int y = 0; y < side; ++y) {
+            for (int x = 0; x < side; ++x) lattice.push_back({10.0 * x, 10.0 * y, {}});
+        }
+        std::shuffle(lattice.begin(), lattice.end(), rng);
+        cases.push_back(lattice);
+    }
+    std::vector<Point> ring;
+    const double pi = std::acos(-1.0);
+    for (int k = 0; k < 12; ++k) ring.push_back({100 + 50 * std::cos(k * pi / 6), 100 + 50 * std::sin(k * pi / 6), {}});
+    cases.push_back(ring);
+    ring.push_back({100, 100, {}});
+    cases.push_back(ring);
+
+    for (const auto &points: cases) {
+        EdgeSet fortune = fortuneEdges(points);
+        std::string name = std::to_string(points.size()) + " sites";
+        expectValidTriangulation(points, fortune, fortune, (name + ", fortune").c_str());
+        expectValidTriangulation(points, edgeSet(Delaunay(points).adjacency()), fortune, (name + ", build").c_str());
+        expectValidTriangulation(points, insertedEdges(points, 0), fortune, (name + ", insert").c_str());
+    }
+}
+
+TEST(DelaunayTest, InsertMatchesBuild) {
+    std::vector<Point> points = randomSites(3000, 5);
+    EdgeSet built = edgeSet(Delaunay(points).adjacency());
+    for (size_t start: {0, 1, 2, 3, 50, 2999}) {
+        EXPECT_EQ(insertedEdges(points, start), built) << start << " sites built first";
+    }
+
+    // Collinear sites first, so the insertions start from a chain with no triangles.
+    std::vector<Point> line;
+    for (int k = 0; k < 6; ++k) line.push_back({10.0 * k, 5.0 * k, {}});
+    line.insert(line.end(), points.begin(), points.begin() + 500);
+    EXPECT_EQ(insertedEdges(line, 3), edgeSet(Delaunay(line).adjacency()));
+}
+
+std::string fileBytes(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+void writeBytes(const std::string &path, const std::string &bytes) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+// Sites whose coordinates and weights are exact in float32, so a round trip must give them back
+// unchanged.
+std::vector<Point> pointFileSites(int n, bool weighted) {
+    std::mt19937 rng(static_cast<unsigned>(n));
+    std::uniform_real_distribution<float> coordinate(-500, 500), weight(0, 10);
+    std::vector<Point> points(n);
+    for (auto &p: points) {
+        p.x = coordinate(rng);
+        p.y = coordinate(rng);
+        p.weight = weighted ? weight(rng) : 0;
+        p.color = {static_cast<Uint8>(rng()), static_cast<Uint8>(rng()), static_cast<Uint8>(rng()),
+                   static_cast<Uint8>(rng())};
+    }
+    return points;
+}
+
+void expectSamePoints(const std::vector<Point> &read, const std::vector<Point> &written, bool colors) {
+    ASSERT_EQ(read.size(), written.size());
+    for (size_t i = 0; i < read.size(); ++i) {
+        EXPECT_EQ(read[i].x, written[i].x) << "site " << i;
+        EXPECT_EQ(read[i].y, written[i].y) << "site " << i;
+        EXPECT_EQ(read[i].weight, written[i].weight) << "site " << i;
+        SDL_Color expected = colors ? written[i].color : SDL_Color{0, 0, 0, 255};
+        EXPECT_TRUE(read[i].color.r == expected.r && read[i].color.g == expected.g &&
+                    read[i].color.b == expected.b && read[i].color.a == expected.a) << "site " << i;
+    }
+}
+
+// Reads the file and expects it to be refused.
+void expectRejected(const std::string &path, const char *what) {
+    std::vector<Point> points;
+    bool hasColors = false;
+    std::string error;
+    EXPECT_FALSE(readPointFile(path, points, hasColors, error)) << what;
+    EXPECT_FALSE(error.empty()) << what;
+}
+
+TEST(PointFileTest, VersionOneRoundTrips) {
+    const std::string path = "point_file_test.vpts";
+    for (int n: {0, 1, 3, 1000}) {
+        for (bool colors: {false, true}) {
+            std::vector<Point> points = pointFileSites(n, false);
+            ASSERT_TRUE(writePointFile(path, points, colors));
+            std::string bytes = fileBytes(path);
+            PointFileHeader header;
+            std::memcpy(&header, bytes.data(), sizeof(header));
+            EXPECT_EQ(header.version, 1u);
+            EXPECT_EQ(bytes.size(), pointFileSize(n, colors, false));
+
+            std::vector<Point> read;
+            bool hasColors = !colors;
+            std::string error;
+            ASSERT_TRUE(readPointFile(path, read, hasColors, error)) << error;
+            EXPECT_EQ(hasColors, colors);
+            expectSamePoints(read, points, colors);
+        }
+    }
+    std::remove(path.c_str());
+}
+
+TEST(PointFileTest, RejectsDamagedFiles) {
+    const std::string path = "point_file_test.vpts";
+    ASSERT_TRUE(writePointFile(path, pointFileSites(100, false), true));
+    const std::string valid = fileBytes(path);
+
+    for (size_t length: {size_t(0), size_t(4), sizeof(PointFileHeader) - 1, pointFileYsOffset(100),
+                         valid.size() - 1}) {
+        writeBytes(path, valid.substr(0, length));
+        expectRejected(path, ("truncated to " + std::to_string(length) + " bytes").c_str());
+    }
+
+    std::string bytes = valid;
+    bytes[0] ^= 1;
+    writeBytes(path, bytes);
+    expectRejected(path, "bad magic");
+    EXPECT_FALSE(isPointFile(path));
+
+    for (uint32_t version: {0u, POINT_FILE_VERSION + 1, 0xFFFFFFFFu}) {
+        bytes = valid;
+        std::memcpy(&bytes[offsetof(PointFileHeader, version)], &version, sizeof(version));
+        writeBytes(path, bytes);
+        expectRejected(path, ("version " + std::to_string(version)).c_str());
+    }
+
+    // A count that only fits a wrapped-around size must not pass the bounds check.
+    bytes = valid;
+    uint64_t count = ~uint64_t(0) / 4;
+    std::memcpy(&bytes[offsetof(PointFileHeader, count)], &count, sizeof(count));
+    writeBytes(path, bytes);
+    expectRejected(path, "huge count");
+    std::remove(path.c_str());
+}
+
+TEST(PointFileTest, WeightedFilesAreVersionTwo) {
+    const std::string path = "point_file_test.vpts";
+    for (bool colors: {false, true}) {
+        std::vector<Point> points = pointFileSites(500, true);
+        ASSERT_TRUE(writePointFile(path, points, colors));
+        std::string bytes = fileBytes(path);
+        PointFileHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        EXPECT_EQ(header.version, 2u);
+        EXPECT_EQ(header.flags & POINT_FILE_WEIGHTS, POINT_FILE_WEIGHTS);
+        EXPECT_EQ(bytes.size(), pointFileSize(500, colors, true));
+
+        std::vector<Point> read;
+        bool hasColors = false;
+        std::string error;
+        ASSERT_TRUE(readPointFile(path, read, hasColors, error)) << error;
+        expectSamePoints(read, points, colors);
+
+        // Without its last weight the file is short, and a version 1 header may not carry
+        // weights at all.
+        writeBytes(path, bytes.substr(0, bytes.size() - 1));
+        expectRejected(path, "truncated weights");
+        header.version = 1;
+        std::memcpy(&bytes[0], &header, sizeof(header));
+        writeBytes(path, bytes);
+        expectRejected(path, "weights in version 1");
+    }
+
+    // A version 2 flag this reader does not know is refused too.
+    ASSERT_TRUE(writePointFile(path, pointFileSites(10, true), true));
+    std::string bytes = fileBytes(path);
+    uint32_t flags = POINT_FILE_COLORS | POINT_FILE_WEIGHTS | 4;
+    std::memcpy(&bytes[offsetof(PointFileHeader, flags)], &flags, sizeof(flags));
+    writeBytes(path, bytes);
+    expectRejected(path, "unknown flag");
+    std::remove(path.c_str());
+}
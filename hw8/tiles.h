@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "profile.h"
+
+const int TILE_SIZE = 64;
+
+struct Tile {
+    int x0, y0, x1, y1;
+};
+
+int defaultThreadCount() {
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+// Each worker starts with a contiguous share of the tiles and pops from the front of its own
+// deque; once empty it steals from the back of the others. Tiles never overlap, so the result
+// does not depend on which worker rendered which tile. fn also gets the worker's index, below
+// threads, for callers that keep per-worker state such as accumulators.
+void forEachTileOnWorkers(int width, int height, int threads,
+                          const std::function<void(const Tile &, int worker)> &fn) {
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += TILE_SIZE) {
+        for (int x = 0; x < width; x += TILE_SIZE) {
+            tiles.push_back({x, y, std::min(x + TILE_SIZE, width), std::min(y + TILE_SIZE, height)});
+        }
+    }
+
+    threads = std::clamp(threads, 1, std::max(1, static_cast<int>(tiles.size())));
+    if (threads == 1) {
+        for (const auto &tile: tiles) fn(tile, 0);
+        PROFILE_FLUSH();
+        return;
+    }
+
+    std::vector<std::deque<int>> queues(threads);
+    std::vector<std::mutex> locks(threads);
+    for (int i = 0; i < static_cast<int>(tiles.size()); ++i) {
+        queues[static_cast<size_t>(i) * threads / tiles.size()].push_back(i);
+    }
+
+    auto worker = [&](int self) {
+        for (;;) {
+            int next = -1;
+            {
+                std::lock_guard<std::mutex> guard(locks[self]);
+                if (!queues[self].empty()) {
+                    next = queues[self].front();
+                    queues[self].pop_front();
+                }
+            }
+            for (int k = 1; next == -1 && k < threads; ++k) {
+                int victim = (self + k) % threads;
+                std::lock_guard<std::mutex> guard(locks[victim]);
+                if (!queues[victim].empty()) {
+                    next = queues[victim].back();
+                    queues[victim].pop_back();
+                }
+            }
+            if (next == -1) return;
+            fn(tiles[next], self);
+            PROFILE_FLUSH();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) {
+        pool.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto &thread: pool) {
+        thread.join();
+    }
+}
+
+void forEachTile(int width, int height, int threads, const std::function<void(const Tile &)> &fn) {
+    forEachTileOnWorkers(width, height, threads, [&](const Tile &tile, int) { fn(tile); });
+}